@@ -15,6 +15,123 @@
 extern "C" {
 #endif
 
+/** @brief Counters of the motion path, see pmw3610_get_stats(). */
+enum pmw3610_stat {
+    PMW3610_STAT_IRQS,          // motion interrupts
+    PMW3610_STAT_BURSTS,        // motion bursts read successfully
+    PMW3610_STAT_SPI_ERRORS,    // failed spi transfers
+    PMW3610_STAT_ZERO_MOTION,   // bursts without displacement
+    PMW3610_STAT_NO_MOTION,     // bursts with the MOTION bit clear, skipped
+    PMW3610_STAT_OVERFLOWS,     // bursts with the delta overflow bit set
+    PMW3610_STAT_REPORTS,       // reports sent to the input subsystem
+    PMW3610_STAT_COALESCED,     // samples held back by the report interval gate
+    PMW3610_STAT_PURGED,        // samples purged by the report interval gate
+    PMW3610_STAT_DROPPED,       // input events rejected by the input subsystem
+    PMW3610_STAT_SMART_TOGGLES, // smart algorithm switches
+    PMW3610_STAT_RECOVERIES,    // re-initialization attempts
+    PMW3610_STAT_CPI_SWITCHES,  // dynamic hardware cpi changes
+    PMW3610_STAT_HEALTH_ID,     // health checks with a wrong product id
+    PMW3610_STAT_HEALTH_CONFIG, // health checks that found a reset configuration
+    PMW3610_STAT_WATCHDOG,      // irq watchdog trips, switching to polling
+    PMW3610_STAT_STUCK_LINE,    // motion line still stuck after polling
+    PMW3610_STAT_BUS_WAITS,     // motion bursts delayed by a low priority bus chunk
+
+    PMW3610_STAT_COUNT
+};
+
+/** @brief Latency segments of the motion path, see pmw3610_get_latency(). */
+enum pmw3610_latency_segment {
+    PMW3610_LATENCY_IRQ_TO_WORK, // motion interrupt to work item start
+    PMW3610_LATENCY_SPI_BURST,   // motion burst transfer
+    PMW3610_LATENCY_PROCESSING,  // burst end to report or gate decision
+    PMW3610_LATENCY_GATE_WAIT,   // oldest accumulated sample to report
+    PMW3610_LATENCY_BUS_WAIT,    // motion burst waiting for the shared bus
+
+    PMW3610_LATENCY_COUNT
+};
+
+/** @brief Kinds of trace records, see pmw3610_trace_dump(). */
+enum pmw3610_trace_type {
+    PMW3610_TRACE_SPI_READ,  // register read or burst, addr/len of the transfer
+    PMW3610_TRACE_SPI_WRITE, // register write, addr of the register
+    PMW3610_TRACE_IRQ,       // motion interrupt
+    PMW3610_TRACE_WORK,      // motion work item
+    PMW3610_TRACE_REPORT,    // report sent to the input subsystem
+    PMW3610_TRACE_INIT_STEP, // async init step, addr is the step
+    PMW3610_TRACE_CONFIG,    // deferred configuration written, addr is 1 after a burst
+
+    PMW3610_TRACE_TYPE_COUNT
+};
+
+/** @brief A single trace record. */
+struct pmw3610_trace_entry {
+    uint32_t                     timestamp; // cycles at start of the event
+    uint32_t                     duration; // cycles
+    uint8_t                      type; // enum pmw3610_trace_type
+    uint8_t                      addr;
+    uint8_t                      len;
+    uint8_t                      clk_on; // spi clock-on requested at the end of the event
+};
+
+/** @brief Operation modes of the sensor downshift chain. */
+enum pmw3610_mode {
+    PMW3610_MODE_RUN,
+    PMW3610_MODE_REST1,
+    PMW3610_MODE_REST2,
+    PMW3610_MODE_REST3,
+
+    PMW3610_MODE_COUNT
+};
+
+/* number of async init steps */
+#define PMW3610_INIT_STEP_COUNT 4
+
+/** @brief Timings of one boot init step, in us since driver init. */
+struct pmw3610_boot_step {
+    uint32_t                     scheduled_us;
+    uint32_t                     started_us;
+    uint32_t                     finished_us;
+    uint32_t                     spi_us; // spi transfer time since scheduled, including polls
+};
+
+/** @brief Boot profile of the async init sequence, see pmw3610_get_boot_profile(). */
+struct pmw3610_boot_profile {
+    struct pmw3610_boot_step     steps[PMW3610_INIT_STEP_COUNT];
+    uint32_t                     init_to_ready_us; // 0 until ready
+    uint32_t                     init_to_first_report_us; // 0 until reported
+};
+
+/** @brief Result of the built-in self test, see pmw3610_bist(). */
+struct pmw3610_bist_result {
+    uint32_t                     crc; // CRC3..CRC0 signature
+    uint32_t                     runtime_ms; // self test command to signature read, the test itself
+                                             // is not observable, this is the wait plus overhead
+    bool                         pass; // signature matches, or no expected value configured
+};
+
+/** @brief Counters and timings of resumes from shutdown. */
+struct pmw3610_resume_metrics {
+    uint32_t                     warm_resumes; // resumes that skipped the self-test
+    uint32_t                     cold_fallbacks; // warm resumes that needed a full init
+    uint32_t                     wake_to_ready_us; // last wake-up command to sensor ready
+    uint32_t                     wake_to_first_report_us; // last wake-up command to first report
+};
+
+/* log2 buckets of the idle gap histogram, bucket i counts [2^(i-1), 2^i) ms */
+#define PMW3610_GAP_BUCKETS 20
+
+/* sensor configuration shadow, mirrors the values applied to the sensor */
+struct pixart_shadow {
+    uint16_t                     cpi;
+    uint8_t                      performance; // PERFORMANCE register
+    uint32_t                     run_downshift_ms;
+    uint32_t                     rest1_downshift_ms;
+    uint32_t                     rest2_downshift_ms;
+    uint32_t                     rest1_sample_ms;
+    uint32_t                     rest2_sample_ms;
+    uint32_t                     rest3_sample_ms;
+};
+
 /* device data structure */
 struct pixart_data {
     const struct device          *dev;
@@ -25,10 +142,146 @@ struct pixart_data {
 
     struct k_work_delayable      init_work; // the work structure for delayable init steps
     int                          async_init_step;
+    int64_t                      step_scheduled_ms; // uptime the current step was scheduled at
+    uint32_t                     init_wait_ms[PMW3610_INIT_STEP_COUNT]; // wait before each step
 
     bool                         ready; // whether init is finished successfully
     bool                         last_read_burst;
+    uint8_t                      burst_len; // register count read per motion burst
     int                          err; // error code during async init
+
+    struct pixart_shadow         shadow; // current sensor configuration, owned by the system workqueue
+    struct pixart_shadow         snap[2]; // published copies of shadow, readable from any thread
+    atomic_t                     snap_seq; // publish count, snap[snap_seq & 1] is current
+    struct k_work                owner_work; // runs owner_fn on the system workqueue
+    struct k_mutex               owner_lock; // one owner call in flight
+    int                          (*owner_fn)(const struct device *dev, void *arg);
+    void                         *owner_arg;
+    int                          owner_err;
+#if IS_ENABLED(CONFIG_PMW3610_DEFERRED_CONFIG)
+    struct k_work_delayable      pending_work; // applies staged changes of an idle sensor
+    struct k_spinlock            pending_lock;
+    struct pixart_shadow         pending; // staged configuration, valid where masked
+    uint32_t                     pending_mask; // staged fields, BIT(PENDING_*)
+    uint8_t                      pending_perf_mask; // staged PERFORMANCE bits
+#endif
+
+    int64_t                      dx; // accumulated delta, not reported yet
+    int64_t                      dy;
+    int64_t                      last_smp_time; // uptime of last report interval sample
+    atomic_t                     last_burst_ms; // low 32 bits of the uptime of last burst
+    int64_t                      last_rpt_time; // uptime of last report
+
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE)
+    // the spi driver skips reconfiguration for an unchanged config pointer,
+    // frequency changes alternate between two copies of the bus spec
+    struct spi_dt_spec           spi[2];
+    uint8_t                      spi_idx; // copy in use
+    bool                         spi_tuned; // stored or tuned frequency applied
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_BUS_ARBITER)
+    struct k_mutex               bus_lock; // held by a bus chunk or a motion burst
+    struct k_condvar             bus_idle; // signalled when no burst is pending
+    atomic_t                     bus_urgent; // motion bursts waiting for or holding the bus
+    uint32_t                     bus_wait_max_us; // longest wait of a motion burst
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_BIST)
+    int64_t                      bist_start_ms; // uptime the running self test started, 0 if none
+    bool                         bist_valid; // bist holds a result
+    bool                         bist_booted; // boot time test was started
+    struct pmw3610_bist_result   bist;
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_SURFACE_STATS)
+    uint8_t                      surface[4]; // squal, pix max, avg, min of last burst
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_OVERFLOW_ACTION_RAISE_RATE)
+    struct k_work_delayable      rate_work; // raises and restores the position rate
+    bool                         rate_boost; // 250 Hz override written to the sensor
+    int64_t                      rate_boost_until; // uptime the override expires
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_DYNAMIC_CPI)
+    uint16_t                     hw_cpi; // cpi in the sensor, shadow.cpi is the one reported at
+    int64_t                      cpi_switch_ms; // uptime of last dynamic cpi change
+    int32_t                      cpi_rem[2]; // remainder of the software gain per axis
+    struct k_work                cpi_work; // writes cpi_req after the burst
+    uint16_t                     cpi_req; // hardware cpi requested by the motion path
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_RECOVERY)
+    uint32_t                     recovery_backoff_ms; // delay before the next recovery attempt
+    uint8_t                      burst_failures; // consecutive failed motion bursts
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_HEALTH_CHECK)
+    struct k_work_delayable      health_work; // periodic idle health check
+    int64_t                      last_activity_ms; // uptime of last motion work
+    uint8_t                      health_idx; // next cached register to verify
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_WATCHDOG)
+    struct k_work_delayable      poll_work; // rate-limited polling while the irq is held off
+    bool                         polling;
+    int64_t                      poll_until; // uptime to check the motion line again
+    int64_t                      wd_window_start; // uptime the irq rate window started
+    uint32_t                     wd_irqs; // irqs in the current window
+    uint32_t                     wd_zero_bursts; // consecutive bursts without motion
+#endif
+
+#if IS_ENABLED(CONFIG_PM_DEVICE)
+    bool                         warm_resume; // next configure step is a warm resume
+    uint32_t                     t_wake; // cycles at the last wake-up command
+    bool                         wake_ready_pending;
+    bool                         wake_report_pending;
+    struct pmw3610_resume_metrics resume;
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_BOOT_PROFILE)
+    uint32_t                     t_boot; // cycles at driver init
+    uint32_t                     spi_cycles; // total spi transfer time
+    uint32_t                     spi_mark; // spi_cycles when the current step was scheduled
+    bool                         boot_ready; // boot sequence finished, stop profiling steps
+    struct pmw3610_boot_profile  boot;
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_STATS)
+    atomic_t                     stats[PMW3610_STAT_COUNT];
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_LATENCY_HISTOGRAM)
+    // cycle stamps of the sample in flight
+    uint32_t                     t_irq;
+    uint32_t                     t_work;
+    uint32_t                     t_burst_start;
+    uint32_t                     t_burst_end;
+    uint32_t                     t_accum; // burst end of oldest unreported sample
+    bool                         accum_pending;
+    // log2 histogram in us, bucket i counts [2^(i-1), 2^i)
+    uint32_t                     latency[PMW3610_LATENCY_COUNT]
+                                        [CONFIG_PMW3610_LATENCY_HISTOGRAM_BUCKETS];
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_POWER_ESTIMATE)
+    int64_t                      last_motion_ms; // uptime of last burst with motion
+    uint64_t                     residency_ms[PMW3610_MODE_COUNT]; // inferred time in each mode
+    bool                         power_suspended; // shut down, no residency accrues
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_ADAPTIVE_DOWNSHIFT)
+    struct k_work_delayable      adapt_work; // periodic downshift controller
+    uint32_t                     gap_hist[PMW3610_GAP_BUCKETS]; // decaying idle gap histogram
+    uint32_t                     gap_count;
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_TRACE)
+    bool                         clk_on;
+    atomic_t                     trace_head; // total records written
+    struct pmw3610_trace_entry   trace[CONFIG_PMW3610_TRACE_BUFFER_SIZE];
+#endif
 };
 
 // device config data structure
@@ -36,6 +289,8 @@ struct pixart_config {
 	struct spi_dt_spec spi;
     struct gpio_dt_spec irq_gpio;
     uint16_t cpi;
+    bool force_awake;
+    bool pos_rate_250;
     uint8_t evt_type;
     uint8_t x_input_code;
     uint8_t y_input_code;
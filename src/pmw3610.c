@@ -8,8 +8,23 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/math_extras.h>
 #include <zephyr/input/input.h>
+#include <zephyr/pm/device.h>
 #include <zmk/keymap.h>
+#if IS_ENABLED(CONFIG_PMW3610_PM_ACTIVITY)
+#include <zmk/event_manager.h>
+#include <zmk/events/activity_state_changed.h>
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_TRACE_ZEPHYR)
+#include <zephyr/tracing/tracing.h>
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_TRACE_FILE)
+#include <zephyr/fs/fs.h>
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE_SETTINGS)
+#include <zephyr/settings/settings.h>
+#endif
 #include "pmw3610.h"
 
 #include <zephyr/logging/log.h>
@@ -42,6 +57,8 @@ static const int32_t async_init_delay[ASYNC_INIT_STEP_COUNT] = {
     [ASYNC_INIT_STEP_CONFIGURE] = 0,
 };
 
+BUILD_ASSERT(ASYNC_INIT_STEP_COUNT == PMW3610_INIT_STEP_COUNT, "Update PMW3610_INIT_STEP_COUNT");
+
 static int pmw3610_async_init_power_up(const struct device *dev);
 static int pmw3610_async_init_clear_ob1(const struct device *dev);
 static int pmw3610_async_init_check_ob1(const struct device *dev);
@@ -54,10 +71,105 @@ static int (*const async_init_fn[ASYNC_INIT_STEP_COUNT])(const struct device *de
     [ASYNC_INIT_STEP_CONFIGURE] = pmw3610_async_init_configure,
 };
 
+#if IS_ENABLED(CONFIG_PMW3610_STATS)
+#define STAT_INC(data, stat) atomic_inc(&(data)->stats[stat])
+#else
+#define STAT_INC(data, stat) ARG_UNUSED(data)
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_LATENCY_HISTOGRAM)
+#define LATENCY_STAMP(data, field) ((data)->field = k_cycle_get_32())
+
+static void latency_record(struct pixart_data *data, enum pmw3610_latency_segment seg,
+                           uint32_t start) {
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    uint32_t bucket = 32 - u32_count_leading_zeros(us);
+
+    data->latency[seg][MIN(bucket, CONFIG_PMW3610_LATENCY_HISTOGRAM_BUCKETS - 1)]++;
+}
+#define LATENCY_RECORD(data, seg, start) latency_record(data, seg, (data)->start)
+#else
+#define LATENCY_STAMP(data, field)
+#define LATENCY_RECORD(data, seg, start)
+#endif
+
+static const char *const trace_type_names[PMW3610_TRACE_TYPE_COUNT] = {
+    [PMW3610_TRACE_SPI_READ] = "spi_rd",
+    [PMW3610_TRACE_SPI_WRITE] = "spi_wr",
+    [PMW3610_TRACE_IRQ] = "irq",
+    [PMW3610_TRACE_WORK] = "work",
+    [PMW3610_TRACE_REPORT] = "report",
+    [PMW3610_TRACE_INIT_STEP] = "init",
+    [PMW3610_TRACE_CONFIG] = "config",
+};
+
+#if IS_ENABLED(CONFIG_PMW3610_TRACE)
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_PMW3610_TRACE_BUFFER_SIZE),
+             "PMW3610 trace buffer size must be a power of two");
+
+#define TRACE_START(var) uint32_t var = k_cycle_get_32()
+
+static void trace_record(struct pixart_data *data, enum pmw3610_trace_type type, uint8_t addr,
+                         uint8_t len, uint32_t start) {
+    // claiming a slot is the only shared step, producers never block each other
+    uint32_t idx = (uint32_t)atomic_inc(&data->trace_head) &
+                   (CONFIG_PMW3610_TRACE_BUFFER_SIZE - 1);
+    struct pmw3610_trace_entry *entry = &data->trace[idx];
+
+    entry->timestamp = start;
+    entry->duration = k_cycle_get_32() - start;
+    entry->type = type;
+    entry->addr = addr;
+    entry->len = len;
+    entry->clk_on = data->clk_on;
+
+#if IS_ENABLED(CONFIG_PMW3610_TRACE_ZEPHYR)
+    sys_trace_named_event(trace_type_names[type],
+                          addr | (len << 8) | ((uint32_t)entry->clk_on << 16),
+                          entry->duration);
+#endif
+}
+#define TRACE(data, type, addr, len, start) trace_record(data, type, addr, len, start)
+#else
+#define TRACE_START(var)
+#define TRACE(data, type, addr, len, start)
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_BOOT_PROFILE)
+#define SPI_TIME_START(var) uint32_t var = k_cycle_get_32()
+#define SPI_TIME_ADD(data, start) ((data)->spi_cycles += k_cycle_get_32() - (start))
+
+static uint32_t boot_elapsed_us(const struct pixart_data *data) {
+    return k_cyc_to_us_floor32(k_cycle_get_32() - data->t_boot);
+}
+
+/* Stamp a boot profile field, steps are only profiled until the first ready */
+#define BOOT_MARK(data, field)                                                                     \
+    do {                                                                                           \
+        if (!(data)->boot_ready) {                                                                 \
+            (data)->boot.field = boot_elapsed_us(data);                                            \
+        }                                                                                          \
+    } while (0)
+#else
+#define SPI_TIME_START(var)
+#define SPI_TIME_ADD(data, start)
+#define BOOT_MARK(data, field)
+#endif
+
 //////// Function definitions //////////
 
-static int pmw3610_read(const struct device *dev, uint8_t addr, uint8_t *value, uint8_t len) {
+/* Bus spec in use, the autotune keeps a tunable copy of the devicetree one */
+static inline const struct spi_dt_spec *pmw3610_spi(const struct device *dev) {
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE)
+	const struct pixart_data *data = dev->data;
+	return &data->spi[data->spi_idx];
+#else
 	const struct pixart_config *cfg = dev->config;
+	return &cfg->spi;
+#endif
+}
+
+static int pmw3610_read(const struct device *dev, uint8_t addr, uint8_t *value, uint8_t len) {
 	const struct spi_buf tx_buf = { .buf = &addr, .len = sizeof(addr) };
 	const struct spi_buf_set tx = { .buffers = &tx_buf, .count = 1 };
 	struct spi_buf rx_buf[] = {
@@ -65,7 +177,15 @@ static int pmw3610_read(const struct device *dev, uint8_t addr, uint8_t *value,
 		{ .buf = value, .len = len, },
 	};
 	const struct spi_buf_set rx = { .buffers = rx_buf, .count = ARRAY_SIZE(rx_buf) };
-	return spi_transceive_dt(&cfg->spi, &tx, &rx);
+	TRACE_START(start);
+	SPI_TIME_START(spi_start);
+	int err = spi_transceive_dt(pmw3610_spi(dev), &tx, &rx);
+	SPI_TIME_ADD((struct pixart_data *)dev->data, spi_start);
+	TRACE((struct pixart_data *)dev->data, PMW3610_TRACE_SPI_READ, addr, len, start);
+	if (unlikely(err)) {
+		STAT_INC((struct pixart_data *)dev->data, PMW3610_STAT_SPI_ERRORS);
+	}
+	return err;
 }
 
 static int pmw3610_read_reg(const struct device *dev, uint8_t addr, uint8_t *value) {
@@ -73,11 +193,24 @@ static int pmw3610_read_reg(const struct device *dev, uint8_t addr, uint8_t *val
 }
 
 static int pmw3610_write_reg(const struct device *dev, uint8_t addr, uint8_t value) {
-	const struct pixart_config *cfg = dev->config;
 	uint8_t write_buf[] = {addr | SPI_WRITE_BIT, value};
 	const struct spi_buf tx_buf = { .buf = write_buf, .len = sizeof(write_buf), };
 	const struct spi_buf_set tx = { .buffers = &tx_buf, .count = 1, };
-	return spi_write_dt(&cfg->spi, &tx);
+	TRACE_START(start);
+	SPI_TIME_START(spi_start);
+	int err = spi_write_dt(pmw3610_spi(dev), &tx);
+	SPI_TIME_ADD((struct pixart_data *)dev->data, spi_start);
+#if IS_ENABLED(CONFIG_PMW3610_TRACE)
+	struct pixart_data *data = dev->data;
+	if (addr == PMW3610_REG_SPI_CLK_ON_REQ && !err) {
+		data->clk_on = (value == PMW3610_SPI_CLOCK_CMD_ENABLE);
+	}
+	TRACE(data, PMW3610_TRACE_SPI_WRITE, addr, 1, start);
+#endif
+	if (unlikely(err)) {
+		STAT_INC((struct pixart_data *)dev->data, PMW3610_STAT_SPI_ERRORS);
+	}
+	return err;
 }
 
 static int pmw3610_write(const struct device *dev, uint8_t reg, uint8_t val) {
@@ -93,7 +226,69 @@ static int pmw3610_write(const struct device *dev, uint8_t reg, uint8_t val) {
     return 0;
 }
 
-static int set_cpi(const struct device *dev, uint32_t cpi) {
+//////// Register owner //////////
+// All sensor transfers are serialized on the system workqueue, which also runs
+// the motion path. Other threads hand their operation over with owner_call().
+// The owner updates data->shadow and publishes it into the spare half of
+// snap[], other threads copy the current half without locking.
+
+typedef int (*owner_fn_t)(const struct device *dev, void *arg);
+
+static void pmw3610_owner_work(struct k_work *work) {
+    struct pixart_data *data = CONTAINER_OF(work, struct pixart_data, owner_work);
+
+    data->owner_err = data->owner_fn(data->dev, data->owner_arg);
+}
+
+/* Run fn on the system workqueue and wait for its result */
+static int owner_call(const struct device *dev, owner_fn_t fn, void *arg) {
+    struct pixart_data *data = dev->data;
+    struct k_work_sync sync;
+    int err;
+
+    if (k_current_get() == k_work_queue_thread_get(&k_sys_work_q)) {
+        return fn(dev, arg);
+    }
+
+    k_mutex_lock(&data->owner_lock, K_FOREVER);
+    data->owner_fn = fn;
+    data->owner_arg = arg;
+    k_work_submit(&data->owner_work);
+    k_work_flush(&data->owner_work, &sync);
+    err = data->owner_err;
+    k_mutex_unlock(&data->owner_lock);
+
+    return err;
+}
+
+/* Make the shadow visible to other threads, call from the system workqueue only */
+static void publish_config(struct pixart_data *data) {
+    atomic_val_t seq = atomic_get(&data->snap_seq);
+
+    data->snap[(seq + 1) & 1] = data->shadow;
+    atomic_inc(&data->snap_seq);
+}
+
+/* Current configuration, stable while on the system workqueue */
+static inline const struct pixart_shadow *active_config(struct pixart_data *data) {
+    return &data->snap[atomic_get(&data->snap_seq) & 1];
+}
+
+/* Copy the current configuration from any thread */
+static void config_snapshot(struct pixart_data *data, struct pixart_shadow *cfg) {
+    atomic_val_t seq;
+
+    // retry if the half being copied got republished meanwhile
+    do {
+        seq = atomic_get(&data->snap_seq);
+        *cfg = data->snap[seq & 1];
+    } while (atomic_get(&data->snap_seq) != seq);
+}
+
+#if !IS_ENABLED(CONFIG_PMW3610_DEFERRED_CONFIG) || IS_ENABLED(CONFIG_PMW3610_DYNAMIC_CPI)
+/* Write the sensor resolution, without touching the configured cpi */
+static int write_cpi(const struct device *dev, uint32_t cpi) {
+
     /* Set resolution with CPI step of 200 cpi
      * 0x1: 200 cpi (minimum cpi)
      * 0x2: 400 cpi
@@ -108,19 +303,18 @@ static int set_cpi(const struct device *dev, uint32_t cpi) {
 
     // Convert CPI to register value
     uint8_t value = (cpi / 200);
-    LOG_INF("Setting CPI to %u (reg value 0x%x)", cpi, value);
 
     /* set the cpi */
     uint8_t addr[] = {0x7F, PMW3610_REG_RES_STEP, 0x7F};
-    uint8_t data[] = {0xFF, value, 0x00};
+    uint8_t buf[] = {0xFF, value, 0x00};
 
 	pmw3610_write_reg(dev, PMW3610_REG_SPI_CLK_ON_REQ, PMW3610_SPI_CLOCK_CMD_ENABLE);
 	k_sleep(K_USEC(T_CLOCK_ON_DELAY_US));
 
     /* Write data */
     int err;
-    for (size_t i = 0; i < sizeof(data); i++) {
-        err = pmw3610_write_reg(dev, addr[i], data[i]);
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        err = pmw3610_write_reg(dev, addr[i], buf[i]);
         if (err) {
             LOG_ERR("Burst write failed on SPI write (data)");
             break;
@@ -133,66 +327,85 @@ static int set_cpi(const struct device *dev, uint32_t cpi) {
         return err;
     }
 
+#if IS_ENABLED(CONFIG_PMW3610_DYNAMIC_CPI)
+    struct pixart_data *data = dev->data;
+    data->hw_cpi = cpi;
+    // remainders are in units of the previous scale
+    data->cpi_rem[0] = data->cpi_rem[1] = 0;
+#endif
     return 0;
 }
+#endif
 
-/* Set sampling rate in each mode (in ms) */
-static int set_sample_time(const struct device *dev, uint8_t reg_addr, uint32_t sample_time) {
-    uint32_t maxtime = 2550;
-    uint32_t mintime = 10;
-    if ((sample_time > maxtime) || (sample_time < mintime)) {
-        LOG_WRN("Sample time %u out of range [%u, %u]", sample_time, mintime, maxtime);
-        return -EINVAL;
-    }
-
-    uint8_t value = sample_time / mintime;
-    LOG_INF("Set sample time to %u ms (reg value: 0x%x)", sample_time, value);
+#if !IS_ENABLED(CONFIG_PMW3610_DEFERRED_CONFIG)
+static int set_cpi(const struct device *dev, uint32_t cpi) {
+    struct pixart_data *data = dev->data;
 
-    /* The sample time is (reg_value * mintime ) ms. 0x00 is rounded to 0x1 */
-    int err = pmw3610_write(dev, reg_addr, value);
+    int err = write_cpi(dev, cpi);
     if (err) {
-        LOG_ERR("Failed to change sample time");
+        return err;
     }
 
-    return err;
+    LOG_INF("Set CPI to %u", cpi);
+    data->shadow.cpi = cpi;
+    publish_config(data);
+    return 0;
 }
+#endif
 
-/* Set downshift time in ms. */
-// NOTE: The unit of run-mode downshift is related to pos mode rate, which is hard coded to be 4 ms
-// The pos-mode rate is configured in pmw3610_async_init_configure
-static int set_downshift_time(const struct device *dev, uint8_t reg_addr, uint32_t time) {
-    uint32_t maxtime;
-    uint32_t mintime;
+//////// Timing model //////////
+// Downshift registers count periods of the mode they leave, so their unit
+// depends on the position rate (RUN) or the REST sample times. All of them
+// are taken from the instance shadow, which follows runtime changes.
+
+/* Position sample period in RUN mode (in ms) */
+static uint32_t pos_rate_ms(const struct pixart_shadow *shadow) {
+    return ((shadow->performance & PMW3610_PERFORMANCE_POS_RATE_MASK) ==
+            PMW3610_PERFORMANCE_POS_RATE_250HZ)
+               ? PMW3610_POS_RATE_250HZ_MS
+               : PMW3610_POS_RATE_DEFAULT_MS;
+}
 
+/* Unit of a downshift register (in ms) */
+static uint32_t downshift_unit_ms(const struct pixart_shadow *shadow, uint8_t reg_addr) {
     switch (reg_addr) {
     case PMW3610_REG_RUN_DOWNSHIFT:
-        /*
-         * Run downshift time = PMW3610_REG_RUN_DOWNSHIFT
-         *                      * 8 * pos-rate (fixed to 4ms)
-         */
-        maxtime = 8160; // 32 * 255;
-        mintime = 32; // hard-coded in pmw3610_async_init_configure
-        break;
-
+        // Run downshift time = PMW3610_REG_RUN_DOWNSHIFT * 8 * pos-rate (4 or 8 ms)
+        return 8 * pos_rate_ms(shadow);
     case PMW3610_REG_REST1_DOWNSHIFT:
-        /*
-         * Rest1 downshift time = PMW3610_REG_RUN_DOWNSHIFT
-         *                        * 16 * Rest1_sample_period (default 40 ms)
-         */
-        maxtime = 255 * 16 * CONFIG_PMW3610_REST1_SAMPLE_TIME_MS;
-        mintime = 16 * CONFIG_PMW3610_REST1_SAMPLE_TIME_MS;
-        break;
-
+        // Rest1 downshift time = PMW3610_REG_REST1_DOWNSHIFT * 16 * Rest1 sample period
+        return 16 * shadow->rest1_sample_ms;
     case PMW3610_REG_REST2_DOWNSHIFT:
-        /*
-         * Rest2 downshift time = PMW3610_REG_REST2_DOWNSHIFT
-         *                        * 128 * Rest2 rate (default 100 ms)
-         */
-        maxtime = 255 * 128 * CONFIG_PMW3610_REST2_SAMPLE_TIME_MS;
-        mintime = 128 * CONFIG_PMW3610_REST2_SAMPLE_TIME_MS;
-        break;
+        // Rest2 downshift time = PMW3610_REG_REST2_DOWNSHIFT * 128 * Rest2 sample period
+        return 128 * shadow->rest2_sample_ms;
+    default:
+        return 0;
+    }
+}
 
+static uint32_t *downshift_shadow(struct pixart_shadow *shadow, uint8_t reg_addr) {
+    switch (reg_addr) {
+    case PMW3610_REG_RUN_DOWNSHIFT:
+        return &shadow->run_downshift_ms;
+    case PMW3610_REG_REST1_DOWNSHIFT:
+        return &shadow->rest1_downshift_ms;
+    case PMW3610_REG_REST2_DOWNSHIFT:
+        return &shadow->rest2_downshift_ms;
     default:
+        return NULL;
+    }
+}
+
+// deferred mode writes through pmw3610_write_config only
+#if !IS_ENABLED(CONFIG_PMW3610_DEFERRED_CONFIG)
+/* Set downshift time in ms. */
+static int set_downshift_time(const struct device *dev, uint8_t reg_addr, uint32_t time) {
+    struct pixart_data *data = dev->data;
+    uint32_t *shadow = downshift_shadow(&data->shadow, reg_addr);
+    uint32_t mintime = downshift_unit_ms(&data->shadow, reg_addr);
+    uint32_t maxtime = 255 * mintime;
+
+    if (shadow == NULL) {
         LOG_ERR("Not supported");
         return -ENOTSUP;
     }
@@ -202,8 +415,6 @@ static int set_downshift_time(const struct device *dev, uint8_t reg_addr, uint32
         return -EINVAL;
     }
 
-    __ASSERT_NO_MSG((mintime > 0) && (maxtime / mintime <= UINT8_MAX));
-
     /* Convert time to register value */
     uint8_t value = time / mintime;
 
@@ -212,18 +423,117 @@ static int set_downshift_time(const struct device *dev, uint8_t reg_addr, uint32
     int err = pmw3610_write(dev, reg_addr, value);
     if (err) {
         LOG_ERR("Failed to change downshift time");
+        return err;
+    }
+
+    *shadow = time;
+    publish_config(data);
+    return 0;
+}
+
+/* Rewrite a downshift register after its unit changed, keeping its wall-clock time */
+static int refresh_downshift_time(const struct device *dev, uint8_t reg_addr) {
+    struct pixart_data *data = dev->data;
+    uint32_t unit = downshift_unit_ms(&data->shadow, reg_addr);
+
+    // the configure step writes all downshift registers anyway
+    if (!data->ready) {
+        return 0;
+    }
+
+    return set_downshift_time(dev, reg_addr,
+                              CLAMP(*downshift_shadow(&data->shadow, reg_addr), unit, 255 * unit));
+}
+
+/* Set sampling rate in each mode (in ms) */
+static int set_sample_time(const struct device *dev, uint8_t reg_addr, uint32_t sample_time) {
+    struct pixart_data *data = dev->data;
+    uint32_t maxtime = 2550;
+    uint32_t mintime = 10;
+    if ((sample_time > maxtime) || (sample_time < mintime)) {
+        LOG_WRN("Sample time %u out of range [%u, %u]", sample_time, mintime, maxtime);
+        return -EINVAL;
+    }
+
+    uint8_t value = sample_time / mintime;
+    LOG_INF("Set sample time to %u ms (reg value: 0x%x)", sample_time, value);
+
+    /* The sample time is (reg_value * mintime ) ms. 0x00 is rounded to 0x1 */
+    int err = pmw3610_write(dev, reg_addr, value);
+    if (err) {
+        LOG_ERR("Failed to change sample time");
+        return err;
+    }
+
+    // keep the effective period, downshift units are derived from it
+    switch (reg_addr) {
+    case PMW3610_REG_REST1_RATE:
+        data->shadow.rest1_sample_ms = value * mintime;
+        err = refresh_downshift_time(dev, PMW3610_REG_REST1_DOWNSHIFT);
+        break;
+    case PMW3610_REG_REST2_RATE:
+        data->shadow.rest2_sample_ms = value * mintime;
+        err = refresh_downshift_time(dev, PMW3610_REG_REST2_DOWNSHIFT);
+        break;
+    case PMW3610_REG_REST3_RATE:
+        data->shadow.rest3_sample_ms = value * mintime;
+        break;
+    }
+
+    publish_config(data);
+    return err;
+}
+
+/* Set force-awake and position rate mode */
+static int set_performance(const struct device *dev, uint8_t perf) {
+    struct pixart_data *data = dev->data;
+    uint32_t prev_pos_rate = pos_rate_ms(&data->shadow);
+
+    int err = pmw3610_write(dev, PMW3610_REG_PERFORMANCE, perf);
+    if (err) {
+        LOG_ERR("Failed to set performance register");
+        return err;
+    }
+
+    LOG_INF("Set performance register (reg value 0x%x)", perf);
+    data->shadow.performance = perf;
+    bool rewrite = prev_pos_rate != pos_rate_ms(&data->shadow);
+#if IS_ENABLED(CONFIG_PMW3610_OVERFLOW_ACTION_RAISE_RATE)
+    // the configured rate replaced the override, and with it its run downshift
+    rewrite |= data->rate_boost;
+    data->rate_boost = false;
+#endif
+
+    if (rewrite) {
+        err = refresh_downshift_time(dev, PMW3610_REG_RUN_DOWNSHIFT);
     }
 
+    publish_config(data);
     return err;
 }
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_EDGE)
+#define PMW3610_INT_ACTIVE GPIO_INT_EDGE_TO_ACTIVE
+#else
+#define PMW3610_INT_ACTIVE GPIO_INT_LEVEL_ACTIVE
+#endif
 
 static void set_interrupt(const struct device *dev, const bool en) {
     const struct pixart_config *config = dev->config;
     int ret = gpio_pin_interrupt_configure_dt(&config->irq_gpio,
-                                              en ? GPIO_INT_LEVEL_ACTIVE : GPIO_INT_DISABLE);
+                                              en ? PMW3610_INT_ACTIVE : GPIO_INT_DISABLE);
     if (ret < 0) {
         LOG_ERR("can't set interrupt");
     }
+
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_EDGE)
+    // no edge is coming for a line asserted before arming
+    if (en && gpio_pin_get_dt(&config->irq_gpio) > 0) {
+        struct pixart_data *data = dev->data;
+        k_work_submit(&data->trigger_work);
+    }
+#endif
 }
 
 static int pmw3610_async_init_power_up(const struct device *dev) {
@@ -238,21 +548,9 @@ static int pmw3610_async_init_clear_ob1(const struct device *dev) {
     return pmw3610_write(dev, PMW3610_REG_OBSERVATION, 0x00);
 }
 
-static int pmw3610_async_init_check_ob1(const struct device *dev) {
-    uint8_t value;
-    int err = pmw3610_read_reg(dev, PMW3610_REG_OBSERVATION, &value);
-    if (err) {
-        LOG_ERR("Can't do self-test");
-        return err;
-    }
-
-    if ((value & 0x0F) != 0x0F) {
-        LOG_ERR("Failed self-test (0x%x)", value);
-        return -EINVAL;
-    }
-
+static int pmw3610_check_product_id(const struct device *dev) {
     uint8_t product_id = 0x01;
-    err = pmw3610_read_reg(dev, PMW3610_REG_PRODUCT_ID, &product_id);
+    int err = pmw3610_read_reg(dev, PMW3610_REG_PRODUCT_ID, &product_id);
     if (err) {
         LOG_ERR("Cannot obtain product id");
         return err;
@@ -266,130 +564,1266 @@ static int pmw3610_async_init_check_ob1(const struct device *dev) {
     return 0;
 }
 
-static int pmw3610_async_init_configure(const struct device *dev) {
-    int err = 0;
-    const struct pixart_config *config = dev->config;
-
-    // clear motion registers first (required in datasheet)
-    for (uint8_t reg = 0x02; (reg <= 0x05) && !err; reg++) {
-        uint8_t buf[1];
-        err = pmw3610_read_reg(dev, reg, buf);
+static int pmw3610_async_init_check_ob1(const struct device *dev) {
+    uint8_t value;
+    int err = pmw3610_read_reg(dev, PMW3610_REG_OBSERVATION, &value);
+    if (err) {
+        LOG_ERR("Can't do self-test");
+        return err;
     }
 
-    if (!err) {
-        err = set_cpi(dev, config->cpi);
+    if ((value & 0x0F) != 0x0F) {
+        LOG_ERR("Failed self-test (0x%x)", value);
+        return -EINVAL;
     }
 
-    // if (!err) {
-    //     uint8_t perf = 0x00;
-    //     if (config->pull_rate_250) {
-    //         perf |= 0x0D;
-    //     }
-    //     if (config->force_awake) {
-    //         perf |= 0xF0;
-    //     }
-    //     err = pmw3610_write(dev, PMW3610_REG_PERFORMANCE, perf);
-    //     LOG_INF("Set performance register (reg value 0x%x)", perf);
-    // }
+    return pmw3610_check_product_id(dev);
+}
+
+/* Clamp a downshift time of the shadow to the range of the current unit */
+static void clamp_downshift_shadow(struct pixart_shadow *shadow, uint8_t reg_addr) {
+    uint32_t unit = downshift_unit_ms(shadow, reg_addr);
+    uint32_t *time = downshift_shadow(shadow, reg_addr);
 
-    if (!err) {
-        err = set_downshift_time(dev, PMW3610_REG_RUN_DOWNSHIFT,
-                                 CONFIG_PMW3610_RUN_DOWNSHIFT_TIME_MS);
-    }
+    *time = CLAMP(*time, unit, 255 * unit);
+}
 
-    if (!err) {
-        err = set_downshift_time(dev, PMW3610_REG_REST1_DOWNSHIFT,
-                                 CONFIG_PMW3610_REST1_DOWNSHIFT_TIME_MS);
+/* Register value the shadow maps to, for the page 0 config registers */
+static uint8_t shadow_reg_value(const struct pixart_shadow *shadow, uint8_t reg_addr) {
+    switch (reg_addr) {
+    case PMW3610_REG_PERFORMANCE:
+        return shadow->performance;
+    case PMW3610_REG_REST1_RATE:
+        return shadow->rest1_sample_ms / 10;
+    case PMW3610_REG_REST2_RATE:
+        return shadow->rest2_sample_ms / 10;
+    case PMW3610_REG_REST3_RATE:
+        return shadow->rest3_sample_ms / 10;
+    case PMW3610_REG_RUN_DOWNSHIFT:
+        return shadow->run_downshift_ms / downshift_unit_ms(shadow, reg_addr);
+    case PMW3610_REG_REST1_DOWNSHIFT:
+        return shadow->rest1_downshift_ms / downshift_unit_ms(shadow, reg_addr);
+    case PMW3610_REG_REST2_DOWNSHIFT:
+        return shadow->rest2_downshift_ms / downshift_unit_ms(shadow, reg_addr);
+    default:
+        return 0;
     }
+}
 
-    if (!err) {
-        err = set_downshift_time(dev, PMW3610_REG_REST2_DOWNSHIFT,
-                                 CONFIG_PMW3610_REST2_DOWNSHIFT_TIME_MS);
-    }
+/*
+ * Write the configuration shadow within a single clock-on window. With prev
+ * given, only the registers whose value differs from prev are written.
+ */
+static int pmw3610_write_config(const struct device *dev, const struct pixart_shadow *prev) {
+    static const uint8_t page0_regs[] = {
+        PMW3610_REG_PERFORMANCE,   PMW3610_REG_REST1_RATE,      PMW3610_REG_REST2_RATE,
+        PMW3610_REG_REST3_RATE,    PMW3610_REG_RUN_DOWNSHIFT,   PMW3610_REG_REST1_DOWNSHIFT,
+        PMW3610_REG_REST2_DOWNSHIFT,
+    };
+    struct pixart_data *data = dev->data;
+    struct pixart_shadow *shadow = &data->shadow;
+    uint8_t seq[3 + ARRAY_SIZE(page0_regs)][2];
+    size_t len = 0;
+    int err = 0;
 
-    if (!err) {
-        err = set_sample_time(dev, PMW3610_REG_REST1_RATE,
-                              CONFIG_PMW3610_REST1_SAMPLE_TIME_MS);
+    // keep the shadow at the effective values, as the setters do
+    shadow->cpi = CLAMP(shadow->cpi, PMW3610_MIN_CPI, PMW3610_MAX_CPI) / 200 * 200;
+    shadow->rest1_sample_ms = CLAMP(shadow->rest1_sample_ms / 10, 1, 255) * 10;
+    shadow->rest2_sample_ms = CLAMP(shadow->rest2_sample_ms / 10, 1, 255) * 10;
+    shadow->rest3_sample_ms = CLAMP(shadow->rest3_sample_ms / 10, 1, 255) * 10;
+    // sample times first, the downshift units are derived from them
+    clamp_downshift_shadow(shadow, PMW3610_REG_RUN_DOWNSHIFT);
+    clamp_downshift_shadow(shadow, PMW3610_REG_REST1_DOWNSHIFT);
+    clamp_downshift_shadow(shadow, PMW3610_REG_REST2_DOWNSHIFT);
+
+    bool cpi_changed = (prev == NULL) || (prev->cpi / 200 != shadow->cpi / 200);
+#if IS_ENABLED(CONFIG_PMW3610_OVERFLOW_ACTION_RAISE_RATE)
+    // the override wrote its own run downshift, dropping it rewrites both
+    bool drop_boost = data->rate_boost &&
+                      (prev == NULL || prev->performance != shadow->performance);
+#endif
+    if (cpi_changed) {
+        seq[len][0] = 0x7F; // page 1
+        seq[len++][1] = 0xFF;
+        seq[len][0] = PMW3610_REG_RES_STEP;
+        seq[len++][1] = shadow->cpi / 200;
+        seq[len][0] = 0x7F; // page 0
+        seq[len++][1] = 0x00;
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(page0_regs); i++) {
+        uint8_t value = shadow_reg_value(shadow, page0_regs[i]);
+        bool write = prev == NULL || shadow_reg_value(prev, page0_regs[i]) != value;
+#if IS_ENABLED(CONFIG_PMW3610_OVERFLOW_ACTION_RAISE_RATE)
+        write |= drop_boost && page0_regs[i] == PMW3610_REG_RUN_DOWNSHIFT;
+#endif
+        if (write) {
+            seq[len][0] = page0_regs[i];
+            seq[len++][1] = value;
+        }
     }
 
-    if (!err) {
-        err = set_sample_time(dev, PMW3610_REG_REST2_RATE,
-                              CONFIG_PMW3610_REST2_SAMPLE_TIME_MS);
+    if (len == 0) {
+        publish_config(data);
+        return 0;
     }
 
-    if (!err) {
-        err = set_sample_time(dev, PMW3610_REG_REST3_RATE,
-                              CONFIG_PMW3610_REST3_SAMPLE_TIME_MS);
+	pmw3610_write_reg(dev, PMW3610_REG_SPI_CLK_ON_REQ, PMW3610_SPI_CLOCK_CMD_ENABLE);
+	k_sleep(K_USEC(T_CLOCK_ON_DELAY_US));
+
+    for (size_t i = 0; i < len && !err; i++) {
+        err = pmw3610_write_reg(dev, seq[i][0], seq[i][1]);
     }
 
+    pmw3610_write_reg(dev, PMW3610_REG_SPI_CLK_ON_REQ, PMW3610_SPI_CLOCK_CMD_DISABLE);
+
     if (err) {
-        LOG_ERR("Config the sensor failed");
+        // keep publishing what the sensor got last, a full write (configure
+        // step or health check) retries the whole shadow
+        if (prev != NULL) {
+            *shadow = *prev;
+        }
         return err;
     }
 
+#if IS_ENABLED(CONFIG_PMW3610_DYNAMIC_CPI)
+    if (cpi_changed) {
+        data->hw_cpi = shadow->cpi;
+        data->cpi_rem[0] = data->cpi_rem[1] = 0;
+    }
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_OVERFLOW_ACTION_RAISE_RATE)
+    if (drop_boost) {
+        data->rate_boost = false; // the configured rate replaced the override
+    }
+#endif
+
+    publish_config(data);
+    LOG_INF("Applied cpi %u, perf 0x%02x, downshift %u/%u/%u ms, sample %u/%u/%u ms",
+            shadow->cpi, shadow->performance, shadow->run_downshift_ms,
+            shadow->rest1_downshift_ms, shadow->rest2_downshift_ms, shadow->rest1_sample_ms,
+            shadow->rest2_sample_ms, shadow->rest3_sample_ms);
     return 0;
 }
 
-static void pmw3610_async_init(struct k_work *work) {
-    struct k_work_delayable *work2 = (struct k_work_delayable *)work;
-    struct pixart_data *data = CONTAINER_OF(work2, struct pixart_data, init_work);
-    const struct device *dev = data->dev;
-
-    LOG_INF("PMW3610 async init step %d", data->async_init_step);
+/* Write the whole configuration shadow */
+static int pmw3610_apply_config(const struct device *dev) {
+    return pmw3610_write_config(dev, NULL);
+}
 
-    data->err = async_init_fn[data->async_init_step](dev);
-    if (data->err) {
-        LOG_ERR("PMW3610 initialization failed in step %d", data->async_init_step);
-    } else {
-        data->async_init_step++;
+//////// Deferred configuration //////////
+// attr_set only stages the requested values. The system workqueue merges them
+// into the shadow and writes the changed registers in one clock-on window,
+// right after the next motion burst or at once when the sensor is idle.
+#if IS_ENABLED(CONFIG_PMW3610_DEFERRED_CONFIG)
+enum {
+    PENDING_CPI,
+    PENDING_RUN_DOWNSHIFT,
+    PENDING_REST1_DOWNSHIFT,
+    PENDING_REST2_DOWNSHIFT,
+    PENDING_REST1_RATE,
+    PENDING_REST2_RATE,
+    PENDING_REST3_RATE,
+};
 
-        if (data->async_init_step == ASYNC_INIT_STEP_COUNT) {
-            data->ready = true; // sensor is ready to work
-            LOG_INF("PMW3610 initialized");
-            set_interrupt(dev, true);
-        } else {
-            k_work_schedule(&data->init_work, K_MSEC(async_init_delay[data->async_init_step]));
-        }
+/* Overlay the staged fields onto a configuration */
+static void merge_pending(struct pixart_shadow *cfg, const struct pixart_shadow *pending,
+                          uint32_t mask, uint8_t perf_mask) {
+#define MERGE(bit, field)                                                                          \
+    if (mask & BIT(bit)) {                                                                         \
+        cfg->field = pending->field;                                                               \
     }
+    MERGE(PENDING_CPI, cpi);
+    MERGE(PENDING_RUN_DOWNSHIFT, run_downshift_ms);
+    MERGE(PENDING_REST1_DOWNSHIFT, rest1_downshift_ms);
+    MERGE(PENDING_REST2_DOWNSHIFT, rest2_downshift_ms);
+    MERGE(PENDING_REST1_RATE, rest1_sample_ms);
+    MERGE(PENDING_REST2_RATE, rest2_sample_ms);
+    MERGE(PENDING_REST3_RATE, rest3_sample_ms);
+#undef MERGE
+    cfg->performance = (cfg->performance & ~perf_mask) | (pending->performance & perf_mask);
 }
 
-//teraknights add
-#define AUTOMOUSE_LAYER (DT_PROP(DT_DRV_INST(0), automouse_layer))
-#if AUTOMOUSE_LAYER > 0
-struct k_timer automouse_layer_timer;
-static bool automouse_triggered = false;
+/* Validate an attribute and set it in cfg, the same ranges as the setters */
+static int stage_attr(struct pixart_shadow *cfg, uint32_t attr, const struct sensor_value *val,
+                      uint32_t *mask, uint8_t *perf_mask) {
+    uint32_t time = PMW3610_SVALUE_TO_TIME(*val);
+    uint8_t reg;
+    uint8_t perf;
 
-static void activate_automouse_layer() {
-    automouse_triggered = true;
-    zmk_keymap_layer_activate(AUTOMOUSE_LAYER);
+    switch (attr) {
+    case PMW3610_ATTR_CPI:
+        if (PMW3610_SVALUE_TO_CPI(*val) < PMW3610_MIN_CPI ||
+            PMW3610_SVALUE_TO_CPI(*val) > PMW3610_MAX_CPI) {
+            return -EINVAL;
+        }
+        cfg->cpi = PMW3610_SVALUE_TO_CPI(*val);
+        *mask |= BIT(PENDING_CPI);
+        return 0;
+
+    case PMW3610_ATTR_RUN_DOWNSHIFT_TIME:
+        reg = PMW3610_REG_RUN_DOWNSHIFT;
+        *mask |= BIT(PENDING_RUN_DOWNSHIFT);
+        break;
+
+    case PMW3610_ATTR_REST1_DOWNSHIFT_TIME:
+        reg = PMW3610_REG_REST1_DOWNSHIFT;
+        *mask |= BIT(PENDING_REST1_DOWNSHIFT);
+        break;
+
+    case PMW3610_ATTR_REST2_DOWNSHIFT_TIME:
+        reg = PMW3610_REG_REST2_DOWNSHIFT;
+        *mask |= BIT(PENDING_REST2_DOWNSHIFT);
+        break;
+
+    case PMW3610_ATTR_REST1_SAMPLE_TIME:
+    case PMW3610_ATTR_REST2_SAMPLE_TIME:
+    case PMW3610_ATTR_REST3_SAMPLE_TIME:
+        if (time < 10 || time > 2550) {
+            return -EINVAL;
+        }
+        if (attr == PMW3610_ATTR_REST1_SAMPLE_TIME) {
+            cfg->rest1_sample_ms = time / 10 * 10;
+            *mask |= BIT(PENDING_REST1_RATE);
+        } else if (attr == PMW3610_ATTR_REST2_SAMPLE_TIME) {
+            cfg->rest2_sample_ms = time / 10 * 10;
+            *mask |= BIT(PENDING_REST2_RATE);
+        } else {
+            cfg->rest3_sample_ms = time / 10 * 10;
+            *mask |= BIT(PENDING_REST3_RATE);
+        }
+        return 0;
+
+    case PMW3610_ATTR_FORCE_AWAKE:
+        perf = PMW3610_PERFORMANCE_FORCE_AWAKE;
+        cfg->performance = (cfg->performance & ~perf) | (val->val1 ? perf : 0);
+        *perf_mask |= perf;
+        return 0;
+
+    case PMW3610_ATTR_POS_RATE_250:
+        perf = PMW3610_PERFORMANCE_POS_RATE_MASK;
+        cfg->performance =
+            (cfg->performance & ~perf) | (val->val1 ? PMW3610_PERFORMANCE_POS_RATE_250HZ : 0);
+        *perf_mask |= perf;
+        return 0;
+
+    case PMW3610_ATTR_GAMING_MODE:
+        perf = PMW3610_PERFORMANCE_FORCE_AWAKE | PMW3610_PERFORMANCE_POS_RATE_250HZ;
+        cfg->performance = val->val1 ? perf : 0;
+        *perf_mask = 0xFF;
+        return 0;
+
+    default:
+        return -ENOTSUP;
+    }
+
+    // downshift time, in units of the staged sample times
+    uint32_t unit = downshift_unit_ms(cfg, reg);
+    if (time < unit || time > 255 * unit) {
+        return -EINVAL;
+    }
+    *downshift_shadow(cfg, reg) = time;
+    return 0;
+}
+
+/* Stage an attribute change, callable from any thread */
+static int pmw3610_attr_defer(const struct device *dev, uint32_t attr,
+                              const struct sensor_value *val) {
+    struct pixart_data *data = dev->data;
+    struct pixart_shadow cfg;
+    uint32_t mask = 0;
+    uint8_t perf_mask = 0;
+
+    config_snapshot(data, &cfg);
+
+    k_spinlock_key_t key = k_spin_lock(&data->pending_lock);
+    merge_pending(&cfg, &data->pending, data->pending_mask, data->pending_perf_mask);
+    int err = stage_attr(&cfg, attr, val, &mask, &perf_mask);
+    if (!err) {
+        data->pending = cfg;
+        data->pending_mask |= mask;
+        data->pending_perf_mask |= perf_mask;
+    }
+    k_spin_unlock(&data->pending_lock, key);
+
+    if (err) {
+        LOG_WRN("Attribute %u rejected (%d)", attr, err);
+        return err;
+    }
+
+    // a moving sensor picks the change up after its next burst, the
+    // work item covers a sensor that stops before that
+    uint32_t since_burst = k_uptime_get_32() - (uint32_t)atomic_get(&data->last_burst_ms);
+    bool idle = since_burst >= CONFIG_PMW3610_DEFERRED_CONFIG_IDLE_MS;
+    k_work_schedule(&data->pending_work,
+                    idle ? K_NO_WAIT : K_MSEC(CONFIG_PMW3610_DEFERRED_CONFIG_IDLE_MS));
+    return 0;
+}
+
+/* Write all staged changes in one batch, runs on the system workqueue */
+static void apply_pending_config(const struct device *dev, bool after_burst) {
+    struct pixart_data *data = dev->data;
+    struct pixart_shadow prev = data->shadow;
+    TRACE_START(start);
+
+    k_spinlock_key_t key = k_spin_lock(&data->pending_lock);
+    if (data->pending_mask == 0 && data->pending_perf_mask == 0) {
+        k_spin_unlock(&data->pending_lock, key);
+        return;
+    }
+    merge_pending(&data->shadow, &data->pending, data->pending_mask, data->pending_perf_mask);
+    data->pending_mask = 0;
+    data->pending_perf_mask = 0;
+    k_spin_unlock(&data->pending_lock, key);
+
+    // the configure step writes the whole shadow anyway
+    if (!data->ready) {
+        publish_config(data);
+        return;
+    }
+
+    int err = pmw3610_write_config(dev, &prev);
+    if (err) {
+        LOG_ERR("Failed to apply deferred configuration (%d)", err);
+    }
+    TRACE(data, PMW3610_TRACE_CONFIG, after_burst, 0, start);
+}
+
+static void pmw3610_pending_work(struct k_work *work) {
+    struct k_work_delayable *work2 = k_work_delayable_from_work(work);
+    struct pixart_data *data = CONTAINER_OF(work2, struct pixart_data, pending_work);
+
+    apply_pending_config(data->dev, false);
+}
+#define DEFERRED_APPLY(dev) apply_pending_config(dev, true)
+#else
+#define DEFERRED_APPLY(dev)
+#endif
+
+//////// Bus arbiter //////////
+// Low priority clients hold bus_lock for one chunk at a time and back off in
+// bus_idle while a motion burst is pending, so a burst gets the bus at the
+// next chunk boundary.
+#if IS_ENABLED(CONFIG_PMW3610_BUS_ARBITER)
+static void bus_burst_begin(struct pixart_data *data) {
+    uint32_t start = k_cycle_get_32();
+
+    atomic_inc(&data->bus_urgent);
+    if (k_mutex_lock(&data->bus_lock, K_NO_WAIT) == 0) {
+        return;
+    }
+
+    STAT_INC(data, PMW3610_STAT_BUS_WAITS);
+    k_mutex_lock(&data->bus_lock, K_FOREVER);
+    data->bus_wait_max_us =
+        MAX(data->bus_wait_max_us, k_cyc_to_us_floor32(k_cycle_get_32() - start));
+#if IS_ENABLED(CONFIG_PMW3610_LATENCY_HISTOGRAM)
+    latency_record(data, PMW3610_LATENCY_BUS_WAIT, start);
+#endif
+}
+
+static void bus_burst_end(struct pixart_data *data) {
+    // signal while holding the lock, so no chunk client can be between its
+    // bus_urgent check and its condvar wait
+    if (atomic_dec(&data->bus_urgent) == 1) {
+        k_condvar_broadcast(&data->bus_idle);
+    }
+    k_mutex_unlock(&data->bus_lock);
+}
+#define BUS_BURST_BEGIN(data) bus_burst_begin(data)
+#define BUS_BURST_END(data) bus_burst_end(data)
+#else
+#define BUS_BURST_BEGIN(data)
+#define BUS_BURST_END(data)
+#endif
+
+int pmw3610_bus_chunk_begin(const struct device *dev, k_timeout_t timeout) {
+#if IS_ENABLED(CONFIG_PMW3610_BUS_ARBITER)
+    struct pixart_data *data = dev->data;
+    k_timepoint_t deadline = sys_timepoint_calc(timeout);
+
+    if (k_mutex_lock(&data->bus_lock, timeout)) {
+        return -EAGAIN;
+    }
+    // the condvar wait drops the lock, letting the pending bursts in
+    while (atomic_get(&data->bus_urgent) > 0) {
+        if (k_condvar_wait(&data->bus_idle, &data->bus_lock, sys_timepoint_timeout(deadline))) {
+            k_mutex_unlock(&data->bus_lock);
+            return -EAGAIN;
+        }
+    }
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+void pmw3610_bus_chunk_end(const struct device *dev) {
+#if IS_ENABLED(CONFIG_PMW3610_BUS_ARBITER)
+    struct pixart_data *data = dev->data;
+
+    k_mutex_unlock(&data->bus_lock);
+#endif
+}
+
+//////// SPI autotune //////////
+// The link test writes a pseudo-random sequence to REST3_RATE and reads it
+// back, along with the product id pair. The PRBS test mode of the sensor is
+// not used, its protocol is not documented.
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE)
+static void set_spi_frequency(struct pixart_data *data, uint32_t freq_hz) {
+    uint8_t next = !data->spi_idx;
+
+    data->spi[next] = data->spi[data->spi_idx];
+    data->spi[next].config.frequency = freq_hz;
+    data->spi_idx = next;
+}
+
+/* Galois LFSR x^8 + x^6 + x^5 + x^4 + 1, never reaches 0 from a non-zero seed */
+static uint8_t lfsr8_next(uint8_t v) {
+    return (v >> 1) ^ ((v & 1) ? 0xB8 : 0x00);
+}
+
+static int spi_link_test(const struct device *dev) {
+    uint8_t v = 0x5A;
+    uint8_t rd, id[2];
+    int err;
+
+    err = pmw3610_write_reg(dev, PMW3610_REG_SPI_CLK_ON_REQ, PMW3610_SPI_CLOCK_CMD_ENABLE);
+    k_sleep(K_USEC(T_CLOCK_ON_DELAY_US));
+
+    for (int i = 0; (i < CONFIG_PMW3610_SPI_AUTOTUNE_ITERATIONS) && !err; i++) {
+        v = lfsr8_next(v);
+        err = pmw3610_write_reg(dev, PMW3610_REG_REST3_RATE, v);
+        if (!err) {
+            err = pmw3610_read_reg(dev, PMW3610_REG_REST3_RATE, &rd);
+        }
+        if (!err) {
+            err = pmw3610_read_reg(dev, PMW3610_REG_PRODUCT_ID, &id[0]);
+        }
+        if (!err) {
+            err = pmw3610_read_reg(dev, PMW3610_REG_NOT_PROD_ID, &id[1]);
+        }
+        if (!err && (rd != v || id[0] != PMW3610_PRODUCT_ID ||
+                     id[1] != (uint8_t)~PMW3610_PRODUCT_ID)) {
+            err = -EIO;
+        }
+    }
+
+    return err;
+}
+
+static int spi_autotune_run(const struct device *dev, uint32_t *freq_hz) {
+    const struct pixart_config *config = dev->config;
+    struct pixart_data *data = dev->data;
+    uint32_t max = MIN(CONFIG_PMW3610_SPI_AUTOTUNE_MAX_HZ, PMW3610_MAX_SPI_HZ);
+    uint32_t base = MIN(config->spi.config.frequency, max);
+    uint32_t best = 0;
+
+    for (uint32_t f = base; f <= max;
+         f += CONFIG_PMW3610_SPI_AUTOTUNE_STEP_HZ) {
+        set_spi_frequency(data, f);
+        int err = spi_link_test(dev);
+        LOG_DBG("SPI link test at %u Hz: %d", f, err);
+        if (err) {
+            break;
+        }
+        best = f;
+    }
+
+    // back at the base rate, rewrite every register a garbled address at a
+    // failing rate may have hit, the full write releases the clock as well
+    set_spi_frequency(data, base);
+    pmw3610_apply_config(dev);
+
+    if (best == 0) {
+        LOG_ERR("SPI link test fails at %u Hz already", base);
+        *freq_hz = base;
+        return -EIO;
+    }
+
+    *freq_hz = MAX(base, best / 100 * (100 - CONFIG_PMW3610_SPI_AUTOTUNE_MARGIN_PCT));
+    set_spi_frequency(data, *freq_hz);
+    LOG_INF("SPI passes up to %u Hz, using %u Hz", best, *freq_hz);
+    return 0;
+}
+
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE_SETTINGS)
+static void spi_setting_key(const struct device *dev, char *key, size_t size) {
+    snprintk(key, size, "pmw3610/%s/spi_hz", dev->name);
+}
+
+static int spi_setting_load(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+                            void *param) {
+    uint32_t *freq_hz = param;
+
+    if (len != sizeof(*freq_hz)) {
+        return -EINVAL;
+    }
+
+    ssize_t rc = read_cb(cb_arg, freq_hz, sizeof(*freq_hz));
+    return (rc < 0) ? rc : 0;
+}
+#endif
+
+/* Apply the stored frequency, or tune on first boot, once per boot */
+static void spi_autotune_boot(const struct device *dev) {
+    struct pixart_data *data = dev->data;
+    uint32_t freq_hz = 0;
+
+    if (data->spi_tuned) {
+        return;
+    }
+    data->spi_tuned = true;
+
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE_SETTINGS)
+    char key[48];
+    spi_setting_key(dev, key, sizeof(key));
+    settings_load_subtree_direct(key, spi_setting_load, &freq_hz);
+#endif
+
+    if (freq_hz) {
+        // stored by an older build, possibly above the rated clock
+        freq_hz = MIN(freq_hz, PMW3610_MAX_SPI_HZ);
+        LOG_INF("Using stored SPI frequency %u Hz", freq_hz);
+        set_spi_frequency(data, freq_hz);
+        return;
+    }
+
+    if (IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE_BOOT) && !spi_autotune_run(dev, &freq_hz)) {
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE_SETTINGS)
+        settings_save_one(key, &freq_hz, sizeof(freq_hz));
+#endif
+    }
+}
+#endif
+
+static int pmw3610_async_init_configure(const struct device *dev) {
+    int err = 0;
+
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE)
+    spi_autotune_boot(dev);
+#endif
+
+    // clear motion registers first (required in datasheet)
+    for (uint8_t reg = 0x02; (reg <= 0x05) && !err; reg++) {
+        uint8_t buf[1];
+        err = pmw3610_read_reg(dev, reg, buf);
+    }
+
+    if (!err) {
+        err = pmw3610_apply_config(dev);
+    }
+
+    if (err) {
+        LOG_ERR("Config the sensor failed");
+        return err;
+    }
+
+    return 0;
+}
+
+#if IS_ENABLED(CONFIG_PM_DEVICE)
+static void resume_mark(struct pixart_data *data, bool *pending, uint32_t *metric) {
+    if (*pending) {
+        *pending = false;
+        *metric = k_cyc_to_us_floor32(k_cycle_get_32() - data->t_wake);
+    }
+}
+#define RESUME_MARK(data, pending, metric) resume_mark(data, &(data)->pending, &(data)->resume.metric)
+#else
+#define RESUME_MARK(data, pending, metric)
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_INIT_POLL)
+/* Whether the sensor is ready for an init step, steps without a probe always are */
+static bool async_init_probe(const struct device *dev, enum pmw3610_init_step step) {
+    uint8_t value;
+
+    switch (step) {
+    case ASYNC_INIT_STEP_CLEAR_OB1:
+        // sensor answers again after the power-up reset
+        return !pmw3610_read_reg(dev, PMW3610_REG_PRODUCT_ID, &value) &&
+               value == PMW3610_PRODUCT_ID;
+    case ASYNC_INIT_STEP_CHECK_OB1:
+        // self-test finished
+        return !pmw3610_read_reg(dev, PMW3610_REG_OBSERVATION, &value) &&
+               (value & 0x0F) == 0x0F;
+    default:
+        return true;
+    }
+}
+#endif
+
+/* Delay before an init step, polled steps start probing right away */
+static int32_t async_init_step_delay(enum pmw3610_init_step step) {
+#if IS_ENABLED(CONFIG_PMW3610_INIT_POLL)
+    if (step == ASYNC_INIT_STEP_CLEAR_OB1 || step == ASYNC_INIT_STEP_CHECK_OB1) {
+        return CONFIG_PMW3610_INIT_POLL_INTERVAL_MS;
+    }
+#endif
+    return async_init_delay[step];
+}
+
+static void schedule_async_init(struct pixart_data *data, int32_t delay_ms) {
+    data->step_scheduled_ms = k_uptime_get();
+#if IS_ENABLED(CONFIG_PMW3610_BOOT_PROFILE)
+    data->spi_mark = data->spi_cycles;
+#endif
+    BOOT_MARK(data, steps[data->async_init_step].scheduled_us);
+    k_work_reschedule(&data->init_work, K_MSEC(delay_ms));
+}
+
+/* Run the async init sequence again starting from a given step */
+static inline void restart_async_init(struct pixart_data *data, enum pmw3610_init_step step) {
+    data->ready = false;
+    data->async_init_step = step;
+    schedule_async_init(data, async_init_step_delay(step));
+}
+
+#if IS_ENABLED(CONFIG_PMW3610_RECOVERY)
+/* Restart the init sequence after a failure, backing off on repeated attempts */
+static void pmw3610_recover(const struct device *dev) {
+    struct pixart_data *data = dev->data;
+    uint32_t delay = data->recovery_backoff_ms;
+
+    set_interrupt(dev, false);
+    data->ready = false;
+    data->burst_failures = 0;
+    data->recovery_backoff_ms = MIN(2 * delay, CONFIG_PMW3610_RECOVERY_BACKOFF_MAX_MS);
+    STAT_INC(data, PMW3610_STAT_RECOVERIES);
+
+    LOG_WRN("Re-initializing sensor in %u ms", delay);
+    data->async_init_step = ASYNC_INIT_STEP_POWER_UP;
+    schedule_async_init(data, delay + async_init_step_delay(ASYNC_INIT_STEP_POWER_UP));
+}
+#endif
+
+//////// Built-in self test //////////
+// Writing SELF_TEST runs the sensor's own test, it leaves a signature in
+// CRC0-3 and the sensor needs a full init afterwards.
+#if IS_ENABLED(CONFIG_PMW3610_BIST)
+static int bist_start(const struct device *dev) {
+    struct pixart_data *data = dev->data;
+
+    set_interrupt(dev, false);
+    data->ready = false;
+    data->bist_start_ms = k_uptime_get();
+    return pmw3610_write(dev, PMW3610_REG_SELF_TEST, PMW3610_SELF_TEST_CMD);
+}
+
+/* Read and check the signature, then re-initialize the sensor */
+static int bist_finish(const struct device *dev) {
+    struct pixart_data *data = dev->data;
+    uint8_t crc[4];
+    int err = 0;
+
+    for (int i = 0; (i < ARRAY_SIZE(crc)) && !err; i++) {
+        err = pmw3610_read_reg(dev, PMW3610_REG_CRC0 + i, &crc[i]);
+    }
+
+    data->bist.runtime_ms = k_uptime_get() - data->bist_start_ms;
+    data->bist_start_ms = 0;
+
+    // the test leaves the sensor unconfigured
+    restart_async_init(data, ASYNC_INIT_STEP_POWER_UP);
+
+    if (err) {
+        LOG_ERR("Cannot read self test signature");
+        return err;
+    }
+
+    data->bist.crc = sys_get_le32(crc);
+    data->bist.pass = (CONFIG_PMW3610_BIST_EXPECTED_CRC == 0) ||
+                      (data->bist.crc == CONFIG_PMW3610_BIST_EXPECTED_CRC);
+    data->bist_valid = true;
+
+    if (data->bist.pass) {
+        LOG_INF("Self test signature 0x%08x, read %u ms after start", data->bist.crc,
+                data->bist.runtime_ms);
+    } else {
+        LOG_ERR("Self test signature 0x%08x (expecting 0x%08x)", data->bist.crc,
+                CONFIG_PMW3610_BIST_EXPECTED_CRC);
+    }
+
+    return 0;
+}
+#endif
+
+static void pmw3610_async_init(struct k_work *work) {
+    struct k_work_delayable *work2 = (struct k_work_delayable *)work;
+    struct pixart_data *data = CONTAINER_OF(work2, struct pixart_data, init_work);
+    const struct device *dev = data->dev;
+
+#if IS_ENABLED(CONFIG_PMW3610_BIST_BOOT)
+    if (data->bist_start_ms) {
+        bist_finish(dev);
+        return;
+    }
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_WARM_RESUME)
+    // the self-test was skipped, at least make sure the sensor woke up
+    if (data->warm_resume) {
+        data->warm_resume = false;
+        if (pmw3610_check_product_id(dev)) {
+            LOG_WRN("Warm resume failed, falling back to full init");
+            data->resume.cold_fallbacks++;
+            restart_async_init(data, ASYNC_INIT_STEP_POWER_UP);
+            return;
+        }
+    }
+#endif
+
+    uint32_t waited = k_uptime_get() - data->step_scheduled_ms;
+
+#if IS_ENABLED(CONFIG_PMW3610_INIT_POLL)
+    if (!async_init_probe(dev, data->async_init_step)) {
+        if (waited < CONFIG_PMW3610_INIT_POLL_TIMEOUT_MS) {
+            k_work_reschedule(&data->init_work, K_MSEC(CONFIG_PMW3610_INIT_POLL_INTERVAL_MS));
+            return;
+        }
+        LOG_WRN("Sensor not ready for step %d after %u ms", data->async_init_step, waited);
+    }
+#endif
+
+    data->init_wait_ms[data->async_init_step] = waited;
+    LOG_INF("PMW3610 async init step %d (waited %u ms)", data->async_init_step, waited);
+
+    BOOT_MARK(data, steps[data->async_init_step].started_us);
+    TRACE_START(start);
+    data->err = async_init_fn[data->async_init_step](dev);
+    TRACE(data, PMW3610_TRACE_INIT_STEP, data->async_init_step, 0, start);
+    BOOT_MARK(data, steps[data->async_init_step].finished_us);
+#if IS_ENABLED(CONFIG_PMW3610_BOOT_PROFILE)
+    if (!data->boot_ready) {
+        data->boot.steps[data->async_init_step].spi_us =
+            k_cyc_to_us_floor32(data->spi_cycles - data->spi_mark);
+    }
+#endif
+    if (data->err) {
+        LOG_ERR("PMW3610 initialization failed in step %d", data->async_init_step);
+#if IS_ENABLED(CONFIG_PMW3610_RECOVERY)
+        pmw3610_recover(dev);
+#endif
+    } else {
+        data->async_init_step++;
+
+        if (data->async_init_step == ASYNC_INIT_STEP_COUNT) {
+            data->ready = true; // sensor is ready to work
+            LOG_INF("PMW3610 initialized");
+#if IS_ENABLED(CONFIG_PMW3610_BIST_BOOT)
+            // once per boot, the sensor needs to be up for the test
+            if (!data->bist_booted) {
+                data->bist_booted = true;
+                if (bist_start(dev)) {
+                    // bist_start dropped ready, bring the sensor back
+                    LOG_ERR("Cannot start boot self test");
+                    restart_async_init(data, ASYNC_INIT_STEP_POWER_UP);
+                    return;
+                }
+                k_work_reschedule(&data->init_work, K_MSEC(CONFIG_PMW3610_BIST_DURATION_MS));
+                return;
+            }
+#endif
+            set_interrupt(dev, true);
+            RESUME_MARK(data, wake_ready_pending, wake_to_ready_us);
+            BOOT_MARK(data, init_to_ready_us);
+#if IS_ENABLED(CONFIG_PMW3610_BOOT_PROFILE)
+            data->boot_ready = true;
+#endif
+        } else {
+            schedule_async_init(data, async_init_step_delay(data->async_init_step));
+        }
+    }
+}
+
+//////// Power model //////////
+// The sensor walks RUN -> REST1 -> REST2 -> REST3 while there is no motion,
+// any motion brings it back to RUN. Splitting the gaps between motion
+// bursts by the downshift times gives the time spent in each mode.
+#if IS_ENABLED(CONFIG_PMW3610_POWER_ESTIMATE)
+static void split_idle_gap(const struct pixart_shadow *cfg, uint64_t gap_ms,
+                           uint64_t residency_ms[PMW3610_MODE_COUNT]) {
+    if (cfg->performance & PMW3610_PERFORMANCE_FORCE_AWAKE) {
+        residency_ms[PMW3610_MODE_RUN] += gap_ms;
+        return;
+    }
+
+    const uint32_t downshift_ms[] = {
+        [PMW3610_MODE_RUN] = cfg->run_downshift_ms,
+        [PMW3610_MODE_REST1] = cfg->rest1_downshift_ms,
+        [PMW3610_MODE_REST2] = cfg->rest2_downshift_ms,
+    };
+
+    for (int mode = PMW3610_MODE_RUN; mode < PMW3610_MODE_REST3; mode++) {
+        uint64_t t = MIN(gap_ms, downshift_ms[mode]);
+        residency_ms[mode] += t;
+        gap_ms -= t;
+    }
+    residency_ms[PMW3610_MODE_REST3] += gap_ms;
+}
+
+static uint32_t mode_current_ua(const struct pixart_shadow *cfg, enum pmw3610_mode mode) {
+    const uint32_t sample_ms[] = {
+        [PMW3610_MODE_REST1] = cfg->rest1_sample_ms,
+        [PMW3610_MODE_REST2] = cfg->rest2_sample_ms,
+        [PMW3610_MODE_REST3] = cfg->rest3_sample_ms,
+    };
+
+    if (mode == PMW3610_MODE_RUN) {
+        return CONFIG_PMW3610_RUN_CURRENT_UA;
+    }
+
+    // nC per ms is uA
+    return CONFIG_PMW3610_REST_IDLE_CURRENT_UA +
+           CONFIG_PMW3610_REST_FRAME_CHARGE_NC / MAX(sample_ms[mode], 1);
+}
+
+#if IS_ENABLED(CONFIG_PMW3610_ADAPTIVE_DOWNSHIFT)
+static void adapt_record_gap(struct pixart_data *data, uint64_t gap_ms);
+#endif
+
+static void power_track_motion(struct pixart_data *data, int64_t now) {
+    uint64_t gap_ms = now - data->last_motion_ms;
+
+    split_idle_gap(active_config(data), gap_ms, data->residency_ms);
+    data->last_motion_ms = now;
+
+#if IS_ENABLED(CONFIG_PMW3610_ADAPTIVE_DOWNSHIFT)
+    adapt_record_gap(data, gap_ms);
+#endif
+}
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_POWER_ESTIMATE) && IS_ENABLED(CONFIG_PM_DEVICE)
+/* A shut down sensor is in none of the modes, charge the gap up to now and pause */
+static void power_suspend(struct pixart_data *data) {
+    int64_t now = k_uptime_get();
+
+    split_idle_gap(active_config(data), now - data->last_motion_ms, data->residency_ms);
+    data->last_motion_ms = now;
+    data->power_suspended = true;
+}
+
+static void power_resume(struct pixart_data *data) {
+    data->last_motion_ms = k_uptime_get();
+    data->power_suspended = false;
+}
+#define POWER_SUSPEND(data) power_suspend(data)
+#define POWER_RESUME(data) power_resume(data)
+#else
+#define POWER_SUSPEND(data)
+#define POWER_RESUME(data)
+#endif
+
+//////// Usage-adaptive downshift controller //////////
+// Idle gaps are collected in a decaying log2 histogram. Periodically every
+// combination of candidate settings is evaluated against it with the power
+// model above: the cheapest one whose mean wake-up latency (half a sample
+// period of the mode the gap ends in) stays in bounds is applied.
+#if IS_ENABLED(CONFIG_PMW3610_ADAPTIVE_DOWNSHIFT)
+static void adapt_record_gap(struct pixart_data *data, uint64_t gap_ms) {
+    // shorter gaps are continuous motion, spent in RUN whatever the settings
+    if (gap_ms < CONFIG_PMW3610_ADAPTIVE_RUN_DOWNSHIFT_MIN_MS / 2) {
+        return;
+    }
+
+    uint32_t bucket = 64 - u64_count_leading_zeros(gap_ms);
+    data->gap_hist[MIN(bucket, PMW3610_GAP_BUCKETS - 1)]++;
+
+    if (++data->gap_count > CONFIG_PMW3610_ADAPTIVE_HISTORY) {
+        data->gap_count = 0;
+        for (int i = 0; i < PMW3610_GAP_BUCKETS; i++) {
+            data->gap_hist[i] /= 2;
+            data->gap_count += data->gap_hist[i];
+        }
+    }
+}
+
+/* Representative gap of a histogram bucket, the middle of [2^(i-1), 2^i) */
+static uint64_t adapt_bucket_gap(int bucket) {
+    return bucket ? (3ULL << (bucket - 1)) / 2 : 0;
+}
+
+/* Charge (uA * ms) and summed wake-up latency (ms) of a candidate over the histogram */
+static void adapt_cost(const struct pixart_shadow *cfg, const uint32_t *hist, uint64_t *charge,
+                       uint64_t *latency) {
+    const uint32_t wake_ms[PMW3610_MODE_COUNT] = {
+        [PMW3610_MODE_RUN] = 0,
+        [PMW3610_MODE_REST1] = cfg->rest1_sample_ms / 2,
+        [PMW3610_MODE_REST2] = cfg->rest2_sample_ms / 2,
+        [PMW3610_MODE_REST3] = cfg->rest3_sample_ms / 2,
+    };
+
+    *charge = 0;
+    *latency = 0;
+
+    for (int i = 0; i < PMW3610_GAP_BUCKETS; i++) {
+        uint64_t residency_ms[PMW3610_MODE_COUNT] = {0};
+        int last_mode = PMW3610_MODE_RUN;
+
+        if (hist[i] == 0) {
+            continue;
+        }
+
+        split_idle_gap(cfg, adapt_bucket_gap(i), residency_ms);
+        for (int mode = 0; mode < PMW3610_MODE_COUNT; mode++) {
+            *charge += hist[i] * residency_ms[mode] * mode_current_ua(cfg, mode);
+            if (residency_ms[mode]) {
+                last_mode = mode;
+            }
+        }
+        *latency += hist[i] * wake_ms[last_mode];
+    }
+}
+
+/* Next candidate of a doubling sequence up to max, 0 when exhausted */
+static uint32_t adapt_next(uint32_t value, uint32_t max) {
+    return (value >= max) ? 0 : MIN(value * 2, max);
+}
+
+/* Downshift times must be representable in their register units */
+static bool adapt_valid(struct pixart_shadow *cand) {
+    static const uint8_t regs[] = {PMW3610_REG_RUN_DOWNSHIFT, PMW3610_REG_REST1_DOWNSHIFT,
+                                   PMW3610_REG_REST2_DOWNSHIFT};
+
+    for (size_t i = 0; i < ARRAY_SIZE(regs); i++) {
+        uint32_t unit = downshift_unit_ms(cand, regs[i]);
+        uint32_t time = *downshift_shadow(cand, regs[i]);
+        if (time < unit || time > 255 * unit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void adapt_choose(const struct pixart_shadow *current, const uint32_t *hist,
+                         uint32_t gap_count, struct pixart_shadow *best) {
+    const uint64_t max_latency = (uint64_t)CONFIG_PMW3610_ADAPTIVE_MAX_WAKE_LATENCY_MS * gap_count;
+    uint64_t best_charge, best_latency;
+    struct pixart_shadow cand = *current;
+
+    *best = *current;
+    adapt_cost(best, hist, &best_charge, &best_latency);
+
+    for (cand.run_downshift_ms = CONFIG_PMW3610_ADAPTIVE_RUN_DOWNSHIFT_MIN_MS; cand.run_downshift_ms;
+         cand.run_downshift_ms = adapt_next(cand.run_downshift_ms,
+                                            CONFIG_PMW3610_ADAPTIVE_RUN_DOWNSHIFT_MAX_MS)) {
+        for (cand.rest1_downshift_ms = CONFIG_PMW3610_ADAPTIVE_REST1_DOWNSHIFT_MIN_MS;
+             cand.rest1_downshift_ms;
+             cand.rest1_downshift_ms = adapt_next(cand.rest1_downshift_ms,
+                                                  CONFIG_PMW3610_ADAPTIVE_REST1_DOWNSHIFT_MAX_MS)) {
+            for (cand.rest1_sample_ms = CONFIG_PMW3610_ADAPTIVE_REST1_SAMPLE_MIN_MS;
+                 cand.rest1_sample_ms;
+                 cand.rest1_sample_ms = adapt_next(cand.rest1_sample_ms,
+                                                   CONFIG_PMW3610_ADAPTIVE_REST1_SAMPLE_MAX_MS)) {
+                for (cand.rest2_sample_ms = CONFIG_PMW3610_ADAPTIVE_REST2_SAMPLE_MIN_MS;
+                     cand.rest2_sample_ms;
+                     cand.rest2_sample_ms = adapt_next(cand.rest2_sample_ms,
+                                                       CONFIG_PMW3610_ADAPTIVE_REST2_SAMPLE_MAX_MS)) {
+                    uint64_t charge, latency;
+
+                    if (!adapt_valid(&cand)) {
+                        continue;
+                    }
+
+                    adapt_cost(&cand, hist, &charge, &latency);
+
+                    bool fits = latency <= max_latency;
+                    bool best_fits = best_latency <= max_latency;
+                    if ((fits && (!best_fits || charge < best_charge)) ||
+                        (!fits && !best_fits && latency < best_latency)) {
+                        *best = cand;
+                        best_charge = charge;
+                        best_latency = latency;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void pmw3610_adapt_work(struct k_work *work) {
+    struct k_work_delayable *work2 = k_work_delayable_from_work(work);
+    struct pixart_data *data = CONTAINER_OF(work2, struct pixart_data, adapt_work);
+    struct pixart_shadow prev = data->shadow;
+
+    k_work_schedule(&data->adapt_work, K_SECONDS(CONFIG_PMW3610_ADAPTIVE_PERIOD_S));
+
+    if (!data->ready || data->gap_count < CONFIG_PMW3610_ADAPTIVE_MIN_GAPS) {
+        return;
+    }
+
+    adapt_choose(&prev, data->gap_hist, data->gap_count, &data->shadow);
+
+    // one clock-on window for all changed registers, the dependent downshift
+    // registers included
+    int err = pmw3610_write_config(data->dev, &prev);
+    if (err) {
+        LOG_WRN("Adaptive downshift update failed (%d)", err);
+    }
+}
+#endif
+
+//////// Health check //////////
+// A sensor reset by ESD or a supply dip comes back with default settings and
+// keeps reporting motion. While idle, verify the product id and one cached
+// register per run, which is enough since a reset restores all of them.
+#if IS_ENABLED(CONFIG_PMW3610_HEALTH_CHECK)
+static const uint8_t health_regs[] = {
+    PMW3610_REG_PERFORMANCE,     PMW3610_REG_REST1_RATE,      PMW3610_REG_REST2_RATE,
+    PMW3610_REG_REST3_RATE,      PMW3610_REG_RUN_DOWNSHIFT,   PMW3610_REG_REST1_DOWNSHIFT,
+    PMW3610_REG_REST2_DOWNSHIFT,
+};
+
+static void pmw3610_health_work(struct k_work *work) {
+    struct k_work_delayable *work2 = k_work_delayable_from_work(work);
+    struct pixart_data *data = CONTAINER_OF(work2, struct pixart_data, health_work);
+    const struct device *dev = data->dev;
+    uint8_t id[2] = {0};
+    uint8_t value;
+
+    k_work_schedule(&data->health_work, K_SECONDS(CONFIG_PMW3610_HEALTH_CHECK_INTERVAL_S));
+
+    if (!data->ready ||
+        k_uptime_get() - data->last_activity_ms < CONFIG_PMW3610_HEALTH_CHECK_IDLE_MS) {
+        return;
+    }
+
+    if (pmw3610_read_reg(dev, PMW3610_REG_PRODUCT_ID, &id[0]) ||
+        pmw3610_read_reg(dev, PMW3610_REG_NOT_PROD_ID, &id[1]) ||
+        id[0] != PMW3610_PRODUCT_ID || id[1] != (uint8_t)~PMW3610_PRODUCT_ID) {
+        LOG_ERR("Health check: bad product id 0x%02x/0x%02x", id[0], id[1]);
+        STAT_INC(data, PMW3610_STAT_HEALTH_ID);
+#if IS_ENABLED(CONFIG_PMW3610_RECOVERY)
+        pmw3610_recover(dev);
+#endif
+        return;
+    }
+
+    uint8_t reg = health_regs[data->health_idx];
+    data->health_idx = (data->health_idx + 1) % ARRAY_SIZE(health_regs);
+
+    if (pmw3610_read_reg(dev, reg, &value)) {
+        return;
+    }
+
+#if IS_ENABLED(CONFIG_PMW3610_OVERFLOW_ACTION_RAISE_RATE)
+    // the override holds its own values in these until it is dropped
+    if (data->rate_boost &&
+        (reg == PMW3610_REG_PERFORMANCE || reg == PMW3610_REG_RUN_DOWNSHIFT)) {
+        return;
+    }
+#endif
+
+    uint8_t expected = shadow_reg_value(&data->shadow, reg);
+    if (value != expected) {
+        LOG_WRN("Health check: reg 0x%02x is 0x%02x (expecting 0x%02x), reapplying config", reg,
+                value, expected);
+        STAT_INC(data, PMW3610_STAT_HEALTH_CONFIG);
+        // the smart algorithm register was reset as well
+        data->sw_smart_flag = false;
+        pmw3610_apply_config(dev);
+    }
+}
+#endif
+
+int pmw3610_get_power(const struct device *dev, struct pmw3610_power *power) {
+#if IS_ENABLED(CONFIG_PMW3610_POWER_ESTIMATE)
+    struct pixart_data *data = dev->data;
+    uint64_t total_ms = 0;
+    uint64_t charge = 0; // uA * ms
+    struct pixart_shadow cfg;
+
+    config_snapshot(data, &cfg);
+    memcpy(power->residency_ms, data->residency_ms, sizeof(power->residency_ms));
+    // account the gap still in progress, none while suspended
+    if (!data->power_suspended) {
+        split_idle_gap(&cfg, k_uptime_get() - data->last_motion_ms, power->residency_ms);
+    }
+
+    for (int mode = 0; mode < PMW3610_MODE_COUNT; mode++) {
+        total_ms += power->residency_ms[mode];
+        charge += power->residency_ms[mode] * mode_current_ua(&cfg, mode);
+    }
+
+    power->avg_current_ua = total_ms ? charge / total_ms : 0;
+    power->energy_uwh_per_hour = (uint64_t)power->avg_current_ua * CONFIG_PMW3610_SUPPLY_MV / 1000;
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+void pmw3610_reset_power(const struct device *dev) {
+#if IS_ENABLED(CONFIG_PMW3610_POWER_ESTIMATE)
+    struct pixart_data *data = dev->data;
+
+    memset(data->residency_ms, 0, sizeof(data->residency_ms));
+    data->last_motion_ms = k_uptime_get();
+#endif
+}
+
+//teraknights add
+#define AUTOMOUSE_LAYER (DT_PROP(DT_DRV_INST(0), automouse_layer))
+#if AUTOMOUSE_LAYER > 0
+struct k_timer automouse_layer_timer;
+static bool automouse_triggered = false;
+
+static void activate_automouse_layer() {
+    automouse_triggered = true;
+    zmk_keymap_layer_activate(AUTOMOUSE_LAYER);
     k_timer_start(&automouse_layer_timer, K_MSEC(CONFIG_PMW3610_AUTOMOUSE_TIMEOUT_MS), K_NO_WAIT);
 }
 
-static void deactivate_automouse_layer(struct k_timer *timer) {
-    automouse_triggered = false;
-    zmk_keymap_layer_deactivate(AUTOMOUSE_LAYER);
+static void deactivate_automouse_layer(struct k_timer *timer) {
+    automouse_triggered = false;
+    zmk_keymap_layer_deactivate(AUTOMOUSE_LAYER);
+}
+
+K_TIMER_DEFINE(automouse_layer_timer, deactivate_automouse_layer, NULL);
+#endif
+//teraknights end
+
+//////// Overflow rate boost //////////
+// The 250 Hz position rate is written as an override on top of the shadow,
+// which keeps the configured rate. The write happens in its own work item
+// after the burst, and the configured rate returns once overflows stop.
+#if IS_ENABLED(CONFIG_PMW3610_OVERFLOW_ACTION_RAISE_RATE)
+static int rate_boost_write(const struct device *dev, bool boost) {
+    struct pixart_data *data = dev->data;
+    struct pixart_shadow cfg = data->shadow;
+    int err;
+
+    if (boost) {
+        cfg.performance = (cfg.performance & ~PMW3610_PERFORMANCE_POS_RATE_MASK) |
+                          PMW3610_PERFORMANCE_POS_RATE_250HZ;
+    }
+    // the run downshift counts position frames, keep its wall-clock time
+    clamp_downshift_shadow(&cfg, PMW3610_REG_RUN_DOWNSHIFT);
+
+	pmw3610_write_reg(dev, PMW3610_REG_SPI_CLK_ON_REQ, PMW3610_SPI_CLOCK_CMD_ENABLE);
+	k_sleep(K_USEC(T_CLOCK_ON_DELAY_US));
+
+    err = pmw3610_write_reg(dev, PMW3610_REG_PERFORMANCE, cfg.performance);
+    if (!err) {
+        err = pmw3610_write_reg(dev, PMW3610_REG_RUN_DOWNSHIFT,
+                                shadow_reg_value(&cfg, PMW3610_REG_RUN_DOWNSHIFT));
+    }
+
+    pmw3610_write_reg(dev, PMW3610_REG_SPI_CLK_ON_REQ, PMW3610_SPI_CLOCK_CMD_DISABLE);
+    return err;
+}
+
+static void pmw3610_rate_work(struct k_work *work) {
+    struct k_work_delayable *work2 = k_work_delayable_from_work(work);
+    struct pixart_data *data = CONTAINER_OF(work2, struct pixart_data, rate_work);
+    int64_t now = k_uptime_get();
+    bool boost = now < data->rate_boost_until;
+
+    // the configure step writes the plain shadow
+    if (!data->ready) {
+        data->rate_boost = false;
+        return;
+    }
+
+    if (boost != data->rate_boost) {
+        LOG_INF("%s position rate override", boost ? "Raising" : "Dropping");
+        if (rate_boost_write(data->dev, boost)) {
+            k_work_reschedule(&data->rate_work, K_MSEC(CONFIG_PMW3610_OVERFLOW_RAISE_RATE_HOLD_MS));
+            return;
+        }
+        data->rate_boost = boost;
+    }
+
+    if (data->rate_boost) {
+        k_work_reschedule(&data->rate_work, K_MSEC(MAX(data->rate_boost_until - now, 1)));
+    }
+}
+
+/* Called on an overflow from the motion path, never writes to the sensor itself */
+static void rate_boost_request(struct pixart_data *data) {
+    if (pos_rate_ms(active_config(data)) == PMW3610_POS_RATE_250HZ_MS) {
+        return;
+    }
+
+    data->rate_boost_until = k_uptime_get() + CONFIG_PMW3610_OVERFLOW_RAISE_RATE_HOLD_MS;
+    // a running override picks the new expiry up when it times out
+    if (!data->rate_boost) {
+        k_work_reschedule(&data->rate_work, K_NO_WAIT);
+    }
+}
+#endif
+
+//////// Dynamic CPI //////////
+// Near delta saturation the hardware cpi is halved, deltas are scaled back to
+// the configured cpi with the remainder carried over, so the cursor speed
+// stays the same and no counts get lost.
+#if IS_ENABLED(CONFIG_PMW3610_DYNAMIC_CPI)
+#define PMW3610_DELTA_LIMIT 2047
+
+static int16_t dynamic_cpi_scale(struct pixart_data *data, int16_t delta, int32_t *rem) {
+    int32_t num = (int32_t)delta * active_config(data)->cpi + *rem;
+
+    *rem = num % data->hw_cpi;
+    return CLAMP(num / data->hw_cpi, INT16_MIN, INT16_MAX);
+}
+
+static void dynamic_cpi_update(const struct device *dev, int16_t x, int16_t y, bool overflow) {
+    struct pixart_data *data = dev->data;
+    uint32_t peak = MAX(abs(x), abs(y));
+    uint32_t target = active_config(data)->cpi;
+    uint32_t hw = data->hw_cpi;
+    uint32_t cpi = hw;
+    int64_t now = k_uptime_get();
+
+    if (now - data->cpi_switch_ms < CONFIG_PMW3610_DYNAMIC_CPI_MIN_INTERVAL_MS) {
+        return;
+    }
+
+    if (overflow || peak * 100 >= PMW3610_DELTA_LIMIT * CONFIG_PMW3610_DYNAMIC_CPI_HIGH_PCT) {
+        cpi = MAX(hw / 2 / 200 * 200, PMW3610_MIN_CPI);
+    } else if (hw < target && peak * target * 100 <
+                                  PMW3610_DELTA_LIMIT * CONFIG_PMW3610_DYNAMIC_CPI_LOW_PCT * hw) {
+        // scaled to the configured cpi, the motion stays well within range
+        cpi = target;
+    }
+
+    if (cpi == hw) {
+        return;
+    }
+
+    // the clock-on window is not opened within the burst
+    data->cpi_req = cpi;
+    data->cpi_switch_ms = now;
+    k_work_submit(&data->cpi_work);
 }
 
-K_TIMER_DEFINE(automouse_layer_timer, deactivate_automouse_layer, NULL);
+static void pmw3610_cpi_work(struct k_work *work) {
+    struct pixart_data *data = CONTAINER_OF(work, struct pixart_data, cpi_work);
+    uint32_t hw = data->hw_cpi;
+
+    // a configuration write or re-init may have set the cpi meanwhile
+    if (!data->ready || data->cpi_req == hw || write_cpi(data->dev, data->cpi_req)) {
+        return;
+    }
+
+    LOG_DBG("Hardware cpi %u -> %u", hw, data->cpi_req);
+    STAT_INC(data, PMW3610_STAT_CPI_SWITCHES);
+}
 #endif
-//teraknights end
 
-static int pmw3610_report_data(const struct device *dev) {
+/* Read one motion burst and accumulate its delta, returns 1 if it had motion */
+static int pmw3610_sample_motion(const struct device *dev) {
     struct pixart_data *data = dev->data;
-    const struct pixart_config *config = dev->config;
-    uint8_t buf[PMW3610_BURST_SIZE];
+    uint8_t buf[PMW3610_MAX_BURST_SIZE];
 
     if (unlikely(!data->ready)) {
         LOG_WRN("Device is not initialized yet");
         return -EBUSY;
     }
 
-    static int64_t dx = 0;
-    static int64_t dy = 0;
-
 #if CONFIG_PMW3610_REPORT_INTERVAL_MIN > 0
-    static int64_t last_smp_time = 0;
-    static int64_t last_rpt_time = 0;
     int64_t now = k_uptime_get();
 #endif
 
@@ -397,16 +1831,58 @@ static int pmw3610_report_data(const struct device *dev) {
 #if AUTOMOUSE_LAYER > 0
 //    if (input_mode == MOVE &&
     if( (automouse_triggered) &&
-            (abs(dx) + abs(dy) > CONFIG_PMW3610_MOVEMENT_THRESHOLD)
+            (abs(data->dx) + abs(data->dy) > CONFIG_PMW3610_MOVEMENT_THRESHOLD)
 ) {
     activate_automouse_layer();
 }
 #endif
 // teraknights end
-	int err = pmw3610_read(dev, PMW3610_REG_MOTION_BURST, buf, sizeof(buf));
+    BUS_BURST_BEGIN(data);
+    LATENCY_STAMP(data, t_burst_start);
+	int err = pmw3610_read(dev, PMW3610_REG_MOTION_BURST, buf, data->burst_len);
+    BUS_BURST_END(data);
     if (err) {
+#if IS_ENABLED(CONFIG_PMW3610_RECOVERY)
+        if (++data->burst_failures >= CONFIG_PMW3610_RECOVERY_BURST_FAILURES) {
+            LOG_ERR("%u motion bursts failed", data->burst_failures);
+            pmw3610_recover(dev);
+        }
+#endif
         return err;
     }
+    STAT_INC(data, PMW3610_STAT_BURSTS);
+    // read by attr_set on other threads, a 64-bit uptime would tear
+    atomic_set(&data->last_burst_ms, (atomic_val_t)k_uptime_get_32());
+#if IS_ENABLED(CONFIG_PMW3610_RECOVERY)
+    // sensor is healthy again
+    data->burst_failures = 0;
+    data->recovery_backoff_ms = CONFIG_PMW3610_RECOVERY_BACKOFF_MIN_MS;
+#endif
+    LATENCY_RECORD(data, PMW3610_LATENCY_SPI_BURST, t_burst_start);
+    LATENCY_STAMP(data, t_burst_end);
+
+    // nothing moved since the last burst, the deltas are not meaningful
+    if (!(buf[0] & PMW3610_MOTION_MOT)) {
+        STAT_INC(data, PMW3610_STAT_NO_MOTION);
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_WATCHDOG)
+        data->wd_zero_bursts++;
+#endif
+        return 0;
+    }
+
+#if IS_ENABLED(CONFIG_PMW3610_SURFACE_STATS)
+    data->surface[0] = buf[PMW3610_SQUAL_POS];
+    data->surface[1] = buf[PMW3610_PIX_MAX_POS];
+    data->surface[2] = buf[PMW3610_PIX_AVG_POS];
+    data->surface[3] = buf[PMW3610_PIX_MIN_POS];
+#endif
+
+    if (buf[0] & PMW3610_MOTION_OVF) {
+        STAT_INC(data, PMW3610_STAT_OVERFLOWS);
+#if IS_ENABLED(CONFIG_PMW3610_OVERFLOW_ACTION_RAISE_RATE)
+        rate_boost_request(data);
+#endif
+    }
 
 // 12-bit two's complement value to int16_t
 // adapted from https://stackoverflow.com/questions/70802306/convert-a-12-bit-signed-number-in-c
@@ -415,6 +1891,30 @@ static int pmw3610_report_data(const struct device *dev) {
     int16_t x = TOINT16((buf[PMW3610_X_L_POS] + ((buf[PMW3610_XY_H_POS] & 0xF0) << 4)), 12);
     int16_t y = TOINT16((buf[PMW3610_Y_L_POS] + ((buf[PMW3610_XY_H_POS] & 0x0F) << 8)), 12);
 
+#if IS_ENABLED(CONFIG_PMW3610_DYNAMIC_CPI)
+    int16_t raw_x = x;
+    int16_t raw_y = y;
+
+    // scale with the cpi the deltas were counted at, then pick the next one
+    x = dynamic_cpi_scale(data, raw_x, &data->cpi_rem[0]);
+    y = dynamic_cpi_scale(data, raw_y, &data->cpi_rem[1]);
+    dynamic_cpi_update(dev, raw_x, raw_y, buf[0] & PMW3610_MOTION_OVF);
+#endif
+
+    if (x == 0 && y == 0) {
+        STAT_INC(data, PMW3610_STAT_ZERO_MOTION);
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_WATCHDOG)
+        data->wd_zero_bursts++;
+#endif
+    } else {
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_WATCHDOG)
+        data->wd_zero_bursts = 0;
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_POWER_ESTIMATE)
+        power_track_motion(data, k_uptime_get());
+#endif
+    }
+
 #if IS_ENABLED(CONFIG_PMW3610_SWAP_XY)
     int16_t a = x;
     x = y;
@@ -427,75 +1927,630 @@ static int pmw3610_report_data(const struct device *dev) {
     y = -y;
 #endif
 
-#ifdef CONFIG_PMW3610_SMART_ALGORITHM
-    int16_t shutter = ((int16_t)(buf[PMW3610_SHUTTER_H_POS] & 0x01) << 8) 
-                    + buf[PMW3610_SHUTTER_L_POS];
-    if (data->sw_smart_flag && shutter < 45) {
-        pmw3610_write(dev, 0x32, 0x00);
-        data->sw_smart_flag = false;
+#ifdef CONFIG_PMW3610_SMART_ALGORITHM
+    int16_t shutter = ((int16_t)(buf[PMW3610_SHUTTER_H_POS] & 0x01) << 8) 
+                    + buf[PMW3610_SHUTTER_L_POS];
+    if (data->sw_smart_flag && shutter < 45) {
+        pmw3610_write(dev, 0x32, 0x00);
+        data->sw_smart_flag = false;
+        STAT_INC(data, PMW3610_STAT_SMART_TOGGLES);
+    }
+    if (!data->sw_smart_flag && shutter > 45) {
+        pmw3610_write(dev, 0x32, 0x80);
+        data->sw_smart_flag = true;
+        STAT_INC(data, PMW3610_STAT_SMART_TOGGLES);
+    }
+#endif
+
+#if CONFIG_PMW3610_REPORT_INTERVAL_MIN > 0
+    // purge accumulated delta, if last sampled had not been reported on last report tick
+    if (now - data->last_smp_time >= CONFIG_PMW3610_REPORT_INTERVAL_MIN) {
+        if (data->dx != 0 || data->dy != 0) {
+            STAT_INC(data, PMW3610_STAT_PURGED);
+        }
+        data->dx = 0;
+        data->dy = 0;
+#if IS_ENABLED(CONFIG_PMW3610_LATENCY_HISTOGRAM)
+        data->accum_pending = false;
+#endif
+    }
+    data->last_smp_time = now;
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_LATENCY_HISTOGRAM)
+    if (!data->accum_pending && (x != 0 || y != 0)) {
+        data->t_accum = data->t_burst_end;
+        data->accum_pending = true;
+    }
+#endif
+
+    // accumulate delta until report in next iteration
+    data->dx += x;
+    data->dy += y;
+
+    return (x != 0 || y != 0) ? 1 : 0;
+}
+
+/* Report the accumulated delta, unless held back by the report interval */
+static void pmw3610_flush_motion(const struct device *dev, bool moved) {
+    struct pixart_data *data = dev->data;
+    const struct pixart_config *config = dev->config;
+
+#if CONFIG_PMW3610_REPORT_INTERVAL_MIN > 0
+    int64_t now = k_uptime_get();
+
+    // strict to report inerval
+    if (now - data->last_rpt_time < CONFIG_PMW3610_REPORT_INTERVAL_MIN) {
+        if (moved) {
+            STAT_INC(data, PMW3610_STAT_COALESCED);
+        }
+        LATENCY_RECORD(data, PMW3610_LATENCY_PROCESSING, t_burst_end);
+        return;
+    }
+#endif
+
+    // fetch report value
+    int16_t rx = (int16_t)CLAMP(data->dx, INT16_MIN, INT16_MAX);
+    int16_t ry = (int16_t)CLAMP(data->dy, INT16_MIN, INT16_MAX);
+    bool have_x = rx != 0;
+    bool have_y = ry != 0;
+
+    LATENCY_RECORD(data, PMW3610_LATENCY_PROCESSING, t_burst_end);
+
+    if (have_x || have_y) {
+#if IS_ENABLED(CONFIG_PMW3610_LATENCY_HISTOGRAM)
+        LATENCY_RECORD(data, PMW3610_LATENCY_GATE_WAIT, t_accum);
+        data->accum_pending = false;
+#endif
+#if CONFIG_PMW3610_REPORT_INTERVAL_MIN > 0
+        data->last_rpt_time = now;
+#endif
+        data->dx = 0;
+        data->dy = 0;
+        STAT_INC(data, PMW3610_STAT_REPORTS);
+        TRACE(data, PMW3610_TRACE_REPORT, 0, 0, k_cycle_get_32());
+        RESUME_MARK(data, wake_report_pending, wake_to_first_report_us);
+#if IS_ENABLED(CONFIG_PMW3610_BOOT_PROFILE)
+        if (data->boot.init_to_first_report_us == 0) {
+            data->boot.init_to_first_report_us = boot_elapsed_us(data);
+        }
+#endif
+        if (have_x &&
+            input_report(dev, config->evt_type, config->x_input_code, rx, !have_y, K_NO_WAIT)) {
+            STAT_INC(data, PMW3610_STAT_DROPPED);
+        }
+        if (have_y &&
+            input_report(dev, config->evt_type, config->y_input_code, ry, true, K_NO_WAIT)) {
+            STAT_INC(data, PMW3610_STAT_DROPPED);
+        }
+    }
+}
+
+#if !IS_ENABLED(CONFIG_PMW3610_IRQ_EDGE) || IS_ENABLED(CONFIG_PMW3610_IRQ_WATCHDOG)
+static int pmw3610_report_data(const struct device *dev) {
+    int ret = pmw3610_sample_motion(dev);
+    if (ret < 0) {
+        return ret;
+    }
+
+    pmw3610_flush_motion(dev, ret > 0);
+    return 0;
+}
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_EDGE)
+/* Read bursts while the motion line stays asserted and report their sum once,
+ * returns whether the line is still asserted after the bounded drain */
+static bool pmw3610_drain_motion(const struct device *dev) {
+    const struct pixart_config *config = dev->config;
+    struct pixart_data *data = dev->data;
+    bool moved = false;
+    bool pending = true;
+
+    for (int i = 0; i < CONFIG_PMW3610_IRQ_EDGE_MAX_BURSTS && pending; i++) {
+        int ret = pmw3610_sample_motion(dev);
+        if (ret < 0) {
+            return false;
+        }
+        if (ret > 0) {
+            if (moved) {
+                STAT_INC(data, PMW3610_STAT_COALESCED);
+            }
+            moved = true;
+        }
+        pending = gpio_pin_get_dt(&config->irq_gpio) > 0;
+    }
+
+    pmw3610_flush_motion(dev, moved);
+    return pending;
+}
+#endif
+
+static int burst_read_owned(const struct device *dev, void *arg) {
+    struct pixart_data *data = dev->data;
+    struct pmw3610_burst *burst = arg;
+    uint8_t buf[PMW3610_MAX_BURST_SIZE];
+
+    if (unlikely(!data->ready)) {
+        return -EBUSY;
+    }
+
+    int err = pmw3610_read(dev, PMW3610_REG_MOTION_BURST, buf, sizeof(buf));
+    if (err) {
+        return err;
+    }
+
+    burst->motion = buf[0];
+    burst->dx = TOINT16((buf[PMW3610_X_L_POS] + ((buf[PMW3610_XY_H_POS] & 0xF0) << 4)), 12);
+    burst->dy = TOINT16((buf[PMW3610_Y_L_POS] + ((buf[PMW3610_XY_H_POS] & 0x0F) << 8)), 12);
+    burst->squal = buf[PMW3610_SQUAL_POS];
+    burst->shutter = ((uint16_t)(buf[PMW3610_SHUTTER_H_POS] & 0x01) << 8)
+                   + buf[PMW3610_SHUTTER_L_POS];
+    burst->pix_max = buf[PMW3610_PIX_MAX_POS];
+    burst->pix_avg = buf[PMW3610_PIX_AVG_POS];
+    burst->pix_min = buf[PMW3610_PIX_MIN_POS];
+
+    return 0;
+}
+
+int pmw3610_burst_read(const struct device *dev, struct pmw3610_burst *burst) {
+    return owner_call(dev, burst_read_owned, burst);
+}
+
+struct reg_read_args {
+    uint8_t addr;
+    uint8_t *value;
+};
+
+static int reg_read_owned(const struct device *dev, void *arg) {
+    struct reg_read_args *args = arg;
+
+    return pmw3610_read_reg(dev, args->addr, args->value);
+}
+
+int pmw3610_reg_read(const struct device *dev, uint8_t addr, uint8_t *value) {
+    struct reg_read_args args = {.addr = addr, .value = value};
+
+    return owner_call(dev, reg_read_owned, &args);
+}
+
+static int self_test_start_owned(const struct device *dev, void *arg) {
+    struct pixart_data *data = dev->data;
+
+    if (unlikely(!data->ready)) {
+        return -EBUSY;
+    }
+
+    return pmw3610_async_init_clear_ob1(dev);
+}
+
+static int self_test_check_owned(const struct device *dev, void *arg) {
+    return pmw3610_async_init_check_ob1(dev);
+}
+
+int pmw3610_self_test(const struct device *dev) {
+    int err = owner_call(dev, self_test_start_owned, NULL);
+    if (err) {
+        return err;
+    }
+
+    // wait on the caller's thread, the motion path keeps running meanwhile
+    k_msleep(async_init_delay[ASYNC_INIT_STEP_CHECK_OB1]);
+    return owner_call(dev, self_test_check_owned, NULL);
+}
+
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE)
+static int spi_autotune_owned(const struct device *dev, void *arg) {
+    struct pixart_data *data = dev->data;
+
+    if (unlikely(!data->ready)) {
+        return -EBUSY;
+    }
+
+    return spi_autotune_run(dev, arg);
+}
+#endif
+
+int pmw3610_spi_autotune(const struct device *dev, uint32_t *freq_hz) {
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE)
+    int err = owner_call(dev, spi_autotune_owned, freq_hz);
+
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE_SETTINGS)
+    if (!err) {
+        char key[48];
+        spi_setting_key(dev, key, sizeof(key));
+        err = settings_save_one(key, freq_hz, sizeof(*freq_hz));
+    }
+#endif
+
+    return err;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+#if IS_ENABLED(CONFIG_PMW3610_BIST)
+static int bist_start_owned(const struct device *dev, void *arg) {
+    struct pixart_data *data = dev->data;
+
+    if (unlikely(!data->ready)) {
+        return -EBUSY;
+    }
+
+    int err = bist_start(dev);
+    if (err) {
+        restart_async_init(data, ASYNC_INIT_STEP_POWER_UP);
+    }
+    return err;
+}
+
+static int bist_finish_owned(const struct device *dev, void *arg) {
+    return bist_finish(dev);
+}
+#endif
+
+int pmw3610_bist(const struct device *dev, struct pmw3610_bist_result *result) {
+#if IS_ENABLED(CONFIG_PMW3610_BIST)
+    struct pixart_data *data = dev->data;
+
+    int err = owner_call(dev, bist_start_owned, NULL);
+    if (err) {
+        return err;
+    }
+
+    // the sensor is not ready until bist_finish, no burst touches it meanwhile
+    k_msleep(CONFIG_PMW3610_BIST_DURATION_MS);
+
+    err = owner_call(dev, bist_finish_owned, NULL);
+    if (err) {
+        return err;
+    }
+
+    *result = data->bist;
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+int pmw3610_get_bist_result(const struct device *dev, struct pmw3610_bist_result *result) {
+#if IS_ENABLED(CONFIG_PMW3610_BIST)
+    struct pixart_data *data = dev->data;
+
+    if (!data->bist_valid) {
+        return -ENODATA;
+    }
+
+    *result = data->bist;
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+int pmw3610_get_status(const struct device *dev, struct pmw3610_status *status) {
+    struct pixart_data *data = dev->data;
+
+    status->ready = data->ready;
+    status->init_step = data->async_init_step;
+    status->init_err = data->err;
+    status->smart_flag = data->sw_smart_flag;
+    status->spi_hz = pmw3610_spi(dev)->config.frequency;
+    status->burst_len = data->burst_len;
+#if IS_ENABLED(CONFIG_PMW3610_SURFACE_STATS)
+    status->squal = data->surface[0];
+    status->pix_max = data->surface[1];
+    status->pix_avg = data->surface[2];
+    status->pix_min = data->surface[3];
+#else
+    status->squal = status->pix_max = status->pix_avg = status->pix_min = 0;
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_WATCHDOG)
+    status->polling = data->polling;
+#else
+    status->polling = false;
+#endif
+    memcpy(status->init_wait_ms, data->init_wait_ms, sizeof(status->init_wait_ms));
+#if IS_ENABLED(CONFIG_PMW3610_BUS_ARBITER)
+    status->bus_wait_max_us = data->bus_wait_max_us;
+#else
+    status->bus_wait_max_us = 0;
+#endif
+    return 0;
+}
+
+static const char *const stat_names[PMW3610_STAT_COUNT] = {
+    [PMW3610_STAT_IRQS] = "irqs",
+    [PMW3610_STAT_BURSTS] = "bursts",
+    [PMW3610_STAT_SPI_ERRORS] = "spi_errors",
+    [PMW3610_STAT_ZERO_MOTION] = "zero_motion",
+    [PMW3610_STAT_NO_MOTION] = "no_motion",
+    [PMW3610_STAT_OVERFLOWS] = "overflows",
+    [PMW3610_STAT_REPORTS] = "reports",
+    [PMW3610_STAT_COALESCED] = "coalesced",
+    [PMW3610_STAT_PURGED] = "purged",
+    [PMW3610_STAT_DROPPED] = "dropped",
+    [PMW3610_STAT_SMART_TOGGLES] = "smart_toggles",
+    [PMW3610_STAT_RECOVERIES] = "recoveries",
+    [PMW3610_STAT_CPI_SWITCHES] = "cpi_switches",
+    [PMW3610_STAT_HEALTH_ID] = "health_id",
+    [PMW3610_STAT_HEALTH_CONFIG] = "health_config",
+    [PMW3610_STAT_WATCHDOG] = "watchdog",
+    [PMW3610_STAT_STUCK_LINE] = "stuck_line",
+    [PMW3610_STAT_BUS_WAITS] = "bus_waits",
+};
+
+const char *pmw3610_stat_name(enum pmw3610_stat stat) {
+    return (stat < PMW3610_STAT_COUNT) ? stat_names[stat] : "unknown";
+}
+
+int pmw3610_get_stats(const struct device *dev, uint32_t stats[PMW3610_STAT_COUNT]) {
+#if IS_ENABLED(CONFIG_PMW3610_STATS)
+    struct pixart_data *data = dev->data;
+
+    for (int i = 0; i < PMW3610_STAT_COUNT; i++) {
+        stats[i] = (uint32_t)atomic_get(&data->stats[i]);
+    }
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+void pmw3610_reset_stats(const struct device *dev) {
+#if IS_ENABLED(CONFIG_PMW3610_STATS)
+    struct pixart_data *data = dev->data;
+
+    for (int i = 0; i < PMW3610_STAT_COUNT; i++) {
+        atomic_clear(&data->stats[i]);
+    }
+#endif
+}
+
+int pmw3610_get_latency(const struct device *dev, enum pmw3610_latency_segment seg,
+                        uint32_t *buckets, size_t count) {
+#if IS_ENABLED(CONFIG_PMW3610_LATENCY_HISTOGRAM)
+    struct pixart_data *data = dev->data;
+
+    if (seg >= PMW3610_LATENCY_COUNT) {
+        return -EINVAL;
+    }
+
+    count = MIN(count, CONFIG_PMW3610_LATENCY_HISTOGRAM_BUCKETS);
+    memcpy(buckets, data->latency[seg], count * sizeof(uint32_t));
+    return count;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+void pmw3610_reset_latency(const struct device *dev) {
+#if IS_ENABLED(CONFIG_PMW3610_LATENCY_HISTOGRAM)
+    struct pixart_data *data = dev->data;
+
+    memset(data->latency, 0, sizeof(data->latency));
+#endif
+}
+
+const char *pmw3610_trace_type_name(uint8_t type) {
+    return (type < PMW3610_TRACE_TYPE_COUNT) ? trace_type_names[type] : "unknown";
+}
+
+int pmw3610_trace_dump(const struct device *dev, pmw3610_trace_cb_t cb, void *user_data) {
+#if IS_ENABLED(CONFIG_PMW3610_TRACE)
+    struct pixart_data *data = dev->data;
+    uint32_t head = (uint32_t)atomic_get(&data->trace_head);
+    uint32_t count = MIN(head, CONFIG_PMW3610_TRACE_BUFFER_SIZE);
+
+    for (uint32_t i = head - count; i != head; i++) {
+        struct pmw3610_trace_entry entry = data->trace[i & (CONFIG_PMW3610_TRACE_BUFFER_SIZE - 1)];
+        cb(&entry, user_data);
+    }
+    return count;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+void pmw3610_trace_clear(const struct device *dev) {
+#if IS_ENABLED(CONFIG_PMW3610_TRACE)
+    struct pixart_data *data = dev->data;
+
+    atomic_clear(&data->trace_head);
+#endif
+}
+
+#if IS_ENABLED(CONFIG_PMW3610_TRACE_FILE)
+struct trace_file_ctx {
+    struct fs_file_t file;
+    int err;
+};
+
+static void trace_save_entry(const struct pmw3610_trace_entry *entry, void *user_data) {
+    struct trace_file_ctx *ctx = user_data;
+    char line[64];
+
+    if (ctx->err) {
+        return;
     }
-    if (!data->sw_smart_flag && shutter > 45) {
-        pmw3610_write(dev, 0x32, 0x80);
-        data->sw_smart_flag = true;
+
+    int len = snprintk(line, sizeof(line), "%u,%s,0x%02x,%u,%u,%u\n",
+                       k_cyc_to_us_floor32(entry->timestamp), pmw3610_trace_type_name(entry->type),
+                       entry->addr, entry->len, entry->clk_on,
+                       k_cyc_to_us_floor32(entry->duration));
+    ssize_t written = fs_write(&ctx->file, line, len);
+    if (written != len) {
+        ctx->err = (written < 0) ? written : -EIO;
     }
+}
 #endif
 
-#if CONFIG_PMW3610_REPORT_INTERVAL_MIN > 0
-    // purge accumulated delta, if last sampled had not been reported on last report tick
-    if (now - last_smp_time >= CONFIG_PMW3610_REPORT_INTERVAL_MIN) {
-        dx = 0;
-        dy = 0;
+int pmw3610_trace_save(const struct device *dev, const char *path) {
+#if IS_ENABLED(CONFIG_PMW3610_TRACE_FILE)
+    static const char header[] = "timestamp_us,type,addr,len,clk_on,duration_us\n";
+    struct trace_file_ctx ctx = {0};
+
+    fs_file_t_init(&ctx.file);
+    int err = fs_open(&ctx.file, path, FS_O_CREATE | FS_O_WRITE);
+    if (err) {
+        LOG_ERR("Cannot open %s (%d)", path, err);
+        return err;
     }
-    last_smp_time = now;
+
+    err = fs_truncate(&ctx.file, 0);
+    if (!err && fs_write(&ctx.file, header, sizeof(header) - 1) != sizeof(header) - 1) {
+        err = -EIO;
+    }
+    if (!err) {
+        pmw3610_trace_dump(dev, trace_save_entry, &ctx);
+        err = ctx.err;
+    }
+
+    fs_close(&ctx.file);
+    return err;
+#else
+    return -ENOTSUP;
 #endif
+}
 
-    // accumulate delta until report in next iteration
-    dx += x;
-    dy += y;
+int pmw3610_get_resume_metrics(const struct device *dev, struct pmw3610_resume_metrics *metrics) {
+#if IS_ENABLED(CONFIG_PM_DEVICE)
+    struct pixart_data *data = dev->data;
 
-#if CONFIG_PMW3610_REPORT_INTERVAL_MIN > 0
-    // strict to report inerval
-    if (now - last_rpt_time < CONFIG_PMW3610_REPORT_INTERVAL_MIN) {
-        return 0;
-    }
+    *metrics = data->resume;
+    return 0;
+#else
+    return -ENOTSUP;
 #endif
+}
 
-    // fetch report value
-    int16_t rx = (int16_t)CLAMP(dx, INT16_MIN, INT16_MAX);
-    int16_t ry = (int16_t)CLAMP(dy, INT16_MIN, INT16_MAX);
-    bool have_x = rx != 0;
-    bool have_y = ry != 0;
+int pmw3610_get_boot_profile(const struct device *dev, struct pmw3610_boot_profile *profile) {
+#if IS_ENABLED(CONFIG_PMW3610_BOOT_PROFILE)
+    struct pixart_data *data = dev->data;
 
-    if (have_x || have_y) {
-#if CONFIG_PMW3610_REPORT_INTERVAL_MIN > 0
-        last_rpt_time = now;
+    *profile = data->boot;
+    return 0;
+#else
+    return -ENOTSUP;
 #endif
-        dx = 0;
-        dy = 0;
-        if (have_x) {
-            input_report(dev, config->evt_type, config->x_input_code, rx, !have_y, K_NO_WAIT);
-        }
-        if (have_y) {
-            input_report(dev, config->evt_type, config->y_input_code, ry, true, K_NO_WAIT);
-        }
+}
+
+//////// Motion line watchdog //////////
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_WATCHDOG)
+static void pmw3610_poll_work(struct k_work *work) {
+    struct k_work_delayable *work2 = k_work_delayable_from_work(work);
+    struct pixart_data *data = CONTAINER_OF(work2, struct pixart_data, poll_work);
+    const struct device *dev = data->dev;
+    const struct pixart_config *config = dev->config;
+    int64_t now = k_uptime_get();
+
+    // recovery or suspend took over
+    if (!data->ready) {
+        data->polling = false;
+        return;
     }
 
-    return err;
+    pmw3610_report_data(dev);
+
+    if (now < data->poll_until) {
+        k_work_schedule(&data->poll_work, K_MSEC(CONFIG_PMW3610_IRQ_WATCHDOG_POLL_MS));
+        return;
+    }
+
+    // the burst just read had no motion but the line is still asserted
+    if (data->wd_zero_bursts > 0 && gpio_pin_get_dt(&config->irq_gpio) > 0) {
+        LOG_ERR("Motion line stuck");
+        STAT_INC(data, PMW3610_STAT_STUCK_LINE);
+#if IS_ENABLED(CONFIG_PMW3610_RECOVERY)
+        data->polling = false;
+        pmw3610_recover(dev);
+#else
+        data->poll_until = now + CONFIG_PMW3610_IRQ_WATCHDOG_HOLD_MS;
+        k_work_schedule(&data->poll_work, K_MSEC(CONFIG_PMW3610_IRQ_WATCHDOG_POLL_MS));
+#endif
+        return;
+    }
+
+    LOG_INF("Motion line recovered, back to irq");
+    data->polling = false;
+    data->wd_window_start = now;
+    data->wd_irqs = 0;
+    data->wd_zero_bursts = 0;
+    set_interrupt(dev, true);
+}
+
+/* Check the irq rate and zero-motion streak, returns true if polling took over */
+static bool watchdog_check(const struct device *dev) {
+    struct pixart_data *data = dev->data;
+    int64_t now = k_uptime_get();
+
+    if (now - data->wd_window_start >= CONFIG_PMW3610_IRQ_WATCHDOG_WINDOW_MS) {
+        data->wd_window_start = now;
+        data->wd_irqs = 0;
+    }
+
+    if (++data->wd_irqs <= CONFIG_PMW3610_IRQ_WATCHDOG_MAX_IRQS &&
+        data->wd_zero_bursts < CONFIG_PMW3610_IRQ_WATCHDOG_ZERO_BURSTS) {
+        return false;
+    }
+
+    LOG_WRN("Irq watchdog tripped (%u irqs, %u zero bursts), polling", data->wd_irqs,
+            data->wd_zero_bursts);
+    STAT_INC(data, PMW3610_STAT_WATCHDOG);
+    set_interrupt(dev, false);
+    data->polling = true;
+    data->poll_until = now + CONFIG_PMW3610_IRQ_WATCHDOG_HOLD_MS;
+    k_work_schedule(&data->poll_work, K_MSEC(CONFIG_PMW3610_IRQ_WATCHDOG_POLL_MS));
+    return true;
 }
+#define WATCHDOG_CHECK(dev) watchdog_check(dev)
+#else
+#define WATCHDOG_CHECK(dev) false
+#endif
 
 static void pmw3610_gpio_callback(const struct device *gpiob, struct gpio_callback *cb,
                                   uint32_t pins) {
     struct pixart_data *data = CONTAINER_OF(cb, struct pixart_data, irq_gpio_cb);
-    const struct device *dev = data->dev;
-    set_interrupt(dev, false);
+    STAT_INC(data, PMW3610_STAT_IRQS);
+    TRACE(data, PMW3610_TRACE_IRQ, 0, 0, k_cycle_get_32());
+    LATENCY_STAMP(data, t_irq);
+#if !IS_ENABLED(CONFIG_PMW3610_IRQ_EDGE)
+    set_interrupt(data->dev, false);
+#endif
     k_work_submit(&data->trigger_work);
 }
 
 static void pmw3610_work_callback(struct k_work *work) {
     struct pixart_data *data = CONTAINER_OF(work, struct pixart_data, trigger_work);
     const struct device *dev = data->dev;
+#if IS_ENABLED(CONFIG_PMW3610_LATENCY_HISTOGRAM)
+    // resubmits of a still asserted line carry no new irq stamp
+    if (data->t_irq != 0) {
+        LATENCY_RECORD(data, PMW3610_LATENCY_IRQ_TO_WORK, t_irq);
+        data->t_irq = 0;
+    }
+#endif
+    TRACE_START(start);
+#if IS_ENABLED(CONFIG_PMW3610_HEALTH_CHECK)
+    data->last_activity_ms = k_uptime_get();
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_EDGE)
+    bool pending = pmw3610_drain_motion(dev);
+    DEFERRED_APPLY(dev);
+
+    // the irq stays armed, keep draining a line that is still asserted
+    if (data->ready && !WATCHDOG_CHECK(dev) && pending) {
+        k_work_submit(&data->trigger_work);
+    }
+#else
     pmw3610_report_data(dev);
-    set_interrupt(dev, true);
+    DEFERRED_APPLY(dev);
+    // a sensor that is (re-)initializing enables the irq when ready
+    if (data->ready && !WATCHDOG_CHECK(dev)) {
+        set_interrupt(dev, true);
+    }
+#endif
+    TRACE(data, PMW3610_TRACE_WORK, 0, 0, start);
 }
 
 static int pmw3610_init_irq(const struct device *dev) {
@@ -540,12 +2595,90 @@ static int pmw3610_init(const struct device *dev) {
     // init device pointer
     data->dev = dev;
 
+#if IS_ENABLED(CONFIG_PMW3610_SPI_AUTOTUNE)
+    data->spi[0] = config->spi;
+    data->spi_idx = 0;
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_BOOT_PROFILE)
+    data->t_boot = k_cycle_get_32();
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_BUS_ARBITER)
+    k_mutex_init(&data->bus_lock);
+    k_condvar_init(&data->bus_idle);
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_RECOVERY)
+    data->recovery_backoff_ms = CONFIG_PMW3610_RECOVERY_BACKOFF_MIN_MS;
+#endif
+
     // init smart algorithm flag;
     data->sw_smart_flag = false;
 
+    // read only the burst registers the enabled features use
+    if (IS_ENABLED(CONFIG_PMW3610_SURFACE_STATS)) {
+        data->burst_len = PMW3610_BURST_SIZE_SURFACE;
+    } else if (IS_ENABLED(CONFIG_PMW3610_SMART_ALGORITHM)) {
+        data->burst_len = PMW3610_BURST_SIZE_SHUTTER;
+    } else {
+        data->burst_len = PMW3610_BURST_SIZE_MOTION;
+    }
+
+    // init configuration shadow, applied to the sensor in the configure step
+    data->shadow = (struct pixart_shadow){
+        .cpi = config->cpi,
+        .performance = (config->pos_rate_250 ? PMW3610_PERFORMANCE_POS_RATE_250HZ : 0) |
+                       (config->force_awake ? PMW3610_PERFORMANCE_FORCE_AWAKE : 0),
+        .run_downshift_ms = CONFIG_PMW3610_RUN_DOWNSHIFT_TIME_MS,
+        .rest1_downshift_ms = CONFIG_PMW3610_REST1_DOWNSHIFT_TIME_MS,
+        .rest2_downshift_ms = CONFIG_PMW3610_REST2_DOWNSHIFT_TIME_MS,
+        .rest1_sample_ms = CONFIG_PMW3610_REST1_SAMPLE_TIME_MS,
+        .rest2_sample_ms = CONFIG_PMW3610_REST2_SAMPLE_TIME_MS,
+        .rest3_sample_ms = CONFIG_PMW3610_REST3_SAMPLE_TIME_MS,
+    };
+    publish_config(data);
+
+#if IS_ENABLED(CONFIG_PMW3610_DYNAMIC_CPI)
+    data->hw_cpi = data->shadow.cpi;
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_POWER_ESTIMATE)
+    data->last_motion_ms = k_uptime_get();
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_ADAPTIVE_DOWNSHIFT)
+    k_work_init_delayable(&data->adapt_work, pmw3610_adapt_work);
+    k_work_schedule(&data->adapt_work, K_SECONDS(CONFIG_PMW3610_ADAPTIVE_PERIOD_S));
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_WATCHDOG)
+    k_work_init_delayable(&data->poll_work, pmw3610_poll_work);
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_OVERFLOW_ACTION_RAISE_RATE)
+    k_work_init_delayable(&data->rate_work, pmw3610_rate_work);
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_DYNAMIC_CPI)
+    k_work_init(&data->cpi_work, pmw3610_cpi_work);
+#endif
+
+#if IS_ENABLED(CONFIG_PMW3610_HEALTH_CHECK)
+    k_work_init_delayable(&data->health_work, pmw3610_health_work);
+    k_work_schedule(&data->health_work, K_SECONDS(CONFIG_PMW3610_HEALTH_CHECK_INTERVAL_S));
+#endif
+
     // init trigger handler work
     k_work_init(&data->trigger_work, pmw3610_work_callback);
 
+    // transfers from other threads are run on the workqueue
+    k_work_init(&data->owner_work, pmw3610_owner_work);
+    k_mutex_init(&data->owner_lock);
+#if IS_ENABLED(CONFIG_PMW3610_DEFERRED_CONFIG)
+    k_work_init_delayable(&data->pending_work, pmw3610_pending_work);
+#endif
+
     // init irq routine
     err = pmw3610_init_irq(dev);
     if (err) {
@@ -559,26 +2692,133 @@ static int pmw3610_init(const struct device *dev) {
     // The sensor is ready to work (i.e., data->ready=true after the above steps are finished)
     k_work_init_delayable(&data->init_work, pmw3610_async_init);
 
-    k_work_schedule(&data->init_work, K_MSEC(async_init_delay[data->async_init_step]));
+    schedule_async_init(data, async_init_step_delay(data->async_init_step));
 
     return err;
 }
 
-static int pmw3610_attr_set(const struct device *dev, enum sensor_channel chan,
-                            enum sensor_attribute attr, const struct sensor_value *val) {
+#if IS_ENABLED(CONFIG_PMW3610_FRAME_ANALYSIS)
+// max reads of PIXEL_GRAB waiting for the valid flag of a single pixel
+#define FRAME_GRAB_PIXEL_RETRY 16
+// mean squared gradient regarded as a perfectly sharp frame
+#define FRAME_SHARPNESS_FULL_SCALE 256
+
+static int frame_grab_pixel(const struct device *dev, uint8_t *pixel) {
+    for (int i = 0; i < FRAME_GRAB_PIXEL_RETRY; i++) {
+        uint8_t value;
+        int err = pmw3610_read_reg(dev, PMW3610_REG_PIXEL_GRAB, &value);
+        if (err) {
+            return err;
+        }
+        if (value & PMW3610_PIXEL_GRAB_VALID) {
+            *pixel = value & PMW3610_PIXEL_DATA_MASK;
+            return 0;
+        }
+    }
+    return -ETIMEDOUT;
+}
+
+static int frame_analyze_owned(const struct device *dev, void *arg) {
     struct pixart_data *data = dev->data;
+    struct pmw3610_frame_quality *quality = arg;
+
+    // only the previous row is kept, for the vertical gradient
+    uint8_t prev_row[PMW3610_FRAME_WIDTH];
+    uint8_t pix_min = UINT8_MAX, pix_max = 0;
+    uint32_t row_min = UINT32_MAX, row_max = 0;
+    uint32_t sum = 0, grad_n = 0;
+    uint64_t grad_sq = 0;
     int err;
 
-    if (unlikely(chan != SENSOR_CHAN_ALL)) {
-        return -ENOTSUP;
+    if (unlikely(!data->ready)) {
+        return -EBUSY;
+    }
+
+    set_interrupt(dev, false);
+    data->ready = false;
+
+    pmw3610_write_reg(dev, PMW3610_REG_SPI_CLK_ON_REQ, PMW3610_SPI_CLOCK_CMD_ENABLE);
+    k_sleep(K_USEC(T_CLOCK_ON_DELAY_US));
+
+    err = pmw3610_write_reg(dev, PMW3610_REG_FRAME_GRAB, PMW3610_FRAME_GRAB_CMD);
+
+    for (int y = 0; (y < PMW3610_FRAME_HEIGHT) && !err; y++) {
+        uint32_t row_sum = 0;
+
+        for (int x = 0; (x < PMW3610_FRAME_WIDTH) && !err; x++) {
+            uint8_t pix;
+            err = frame_grab_pixel(dev, &pix);
+            if (err) {
+                break;
+            }
+
+            sum += pix;
+            row_sum += pix;
+            pix_min = MIN(pix_min, pix);
+            pix_max = MAX(pix_max, pix);
+
+            if (x > 0) {
+                int32_t d = (int32_t)pix - prev_row[x - 1];
+                grad_sq += d * d;
+                grad_n++;
+            }
+            if (y > 0) {
+                int32_t d = (int32_t)pix - prev_row[x];
+                grad_sq += d * d;
+                grad_n++;
+            }
+
+            // prev_row[x - 1] already holds the current row's left neighbour
+            prev_row[x] = pix;
+        }
+
+        row_min = MIN(row_min, row_sum);
+        row_max = MAX(row_max, row_sum);
+    }
+
+    pmw3610_write_reg(dev, PMW3610_REG_SPI_CLK_ON_REQ, PMW3610_SPI_CLOCK_CMD_DISABLE);
+
+    // frame capture halts navigation, bring the sensor back by a full init
+    restart_async_init(data, ASYNC_INIT_STEP_POWER_UP);
+
+    if (err) {
+        LOG_ERR("Frame grab failed");
+        return err;
     }
 
+    quality->mean = sum / (PMW3610_FRAME_WIDTH * PMW3610_FRAME_HEIGHT);
+    quality->sharpness = grad_n ? (uint32_t)(grad_sq / grad_n) : 0;
+    quality->contrast = (pix_max + pix_min) ? (pix_max - pix_min) * 100 / (pix_max + pix_min) : 0;
+    quality->uniformity = row_max ? 100 - (row_max - row_min) * 100 / row_max : 0;
+    quality->score = (MIN(quality->sharpness, FRAME_SHARPNESS_FULL_SCALE) * 100 /
+                          FRAME_SHARPNESS_FULL_SCALE +
+                      quality->contrast + quality->uniformity) / 3;
+
+    LOG_INF("Frame quality: sharpness %u, contrast %u%%, uniformity %u%%, score %u",
+            quality->sharpness, quality->contrast, quality->uniformity, quality->score);
+
+    return 0;
+}
+
+int pmw3610_frame_analyze(const struct device *dev, struct pmw3610_frame_quality *quality) {
+    return owner_call(dev, frame_analyze_owned, quality);
+}
+#endif
+
+#if !IS_ENABLED(CONFIG_PMW3610_DEFERRED_CONFIG)
+/* Apply an attribute to the sensor, runs on the system workqueue */
+static int pmw3610_attr_apply(const struct device *dev, uint32_t attr,
+                              const struct sensor_value *val) {
+    struct pixart_data *data = dev->data;
+    uint8_t perf;
+    int err;
+
     if (unlikely(!data->ready)) {
         LOG_DBG("Device is not initialized yet");
         return -EBUSY;
     }
 
-    switch ((uint32_t)attr) {
+    switch (attr) {
     case PMW3610_ATTR_CPI:
         err = set_cpi(dev, PMW3610_SVALUE_TO_CPI(*val));
         break;
@@ -607,6 +2847,21 @@ static int pmw3610_attr_set(const struct device *dev, enum sensor_channel chan,
         err = set_sample_time(dev, PMW3610_REG_REST3_RATE, PMW3610_SVALUE_TO_TIME(*val));
         break;
 
+    case PMW3610_ATTR_FORCE_AWAKE:
+        perf = data->shadow.performance & ~PMW3610_PERFORMANCE_FORCE_AWAKE;
+        err = set_performance(dev, perf | (val->val1 ? PMW3610_PERFORMANCE_FORCE_AWAKE : 0));
+        break;
+
+    case PMW3610_ATTR_POS_RATE_250:
+        perf = data->shadow.performance & ~PMW3610_PERFORMANCE_POS_RATE_MASK;
+        err = set_performance(dev, perf | (val->val1 ? PMW3610_PERFORMANCE_POS_RATE_250HZ : 0));
+        break;
+
+    case PMW3610_ATTR_GAMING_MODE:
+        perf = PMW3610_PERFORMANCE_FORCE_AWAKE | PMW3610_PERFORMANCE_POS_RATE_250HZ;
+        err = set_performance(dev, val->val1 ? perf : 0);
+        break;
+
     default:
         LOG_ERR("Unknown attribute");
         err = -ENOTSUP;
@@ -615,10 +2870,193 @@ static int pmw3610_attr_set(const struct device *dev, enum sensor_channel chan,
     return err;
 }
 
+struct attr_args {
+    uint32_t attr;
+    const struct sensor_value *val;
+};
+
+static int attr_apply_owned(const struct device *dev, void *arg) {
+    struct attr_args *args = arg;
+
+    return pmw3610_attr_apply(dev, args->attr, args->val);
+}
+#endif
+
+static int pmw3610_attr_set(const struct device *dev, enum sensor_channel chan,
+                            enum sensor_attribute attr, const struct sensor_value *val) {
+    if (unlikely(chan != SENSOR_CHAN_ALL)) {
+        return -ENOTSUP;
+    }
+
+#if IS_ENABLED(CONFIG_PMW3610_DEFERRED_CONFIG)
+    return pmw3610_attr_defer(dev, attr, val);
+#else
+    struct attr_args args = {.attr = attr, .val = val};
+
+    // a burst in progress is never interleaved with configuration writes
+    return owner_call(dev, attr_apply_owned, &args);
+#endif
+}
+
+static int pmw3610_attr_get(const struct device *dev, enum sensor_channel chan,
+                            enum sensor_attribute attr, struct sensor_value *val) {
+    struct pixart_shadow cfg;
+
+    if (unlikely(chan != SENSOR_CHAN_ALL)) {
+        return -ENOTSUP;
+    }
+
+    config_snapshot(dev->data, &cfg);
+    val->val2 = 0;
+
+    switch ((uint32_t)attr) {
+    case PMW3610_ATTR_CPI:
+        val->val1 = cfg.cpi;
+        break;
+
+    case PMW3610_ATTR_RUN_DOWNSHIFT_TIME:
+        val->val1 = cfg.run_downshift_ms;
+        break;
+
+    case PMW3610_ATTR_REST1_DOWNSHIFT_TIME:
+        val->val1 = cfg.rest1_downshift_ms;
+        break;
+
+    case PMW3610_ATTR_REST2_DOWNSHIFT_TIME:
+        val->val1 = cfg.rest2_downshift_ms;
+        break;
+
+    case PMW3610_ATTR_REST1_SAMPLE_TIME:
+        val->val1 = cfg.rest1_sample_ms;
+        break;
+
+    case PMW3610_ATTR_REST2_SAMPLE_TIME:
+        val->val1 = cfg.rest2_sample_ms;
+        break;
+
+    case PMW3610_ATTR_REST3_SAMPLE_TIME:
+        val->val1 = cfg.rest3_sample_ms;
+        break;
+
+    case PMW3610_ATTR_FORCE_AWAKE:
+        val->val1 = !!(cfg.performance & PMW3610_PERFORMANCE_FORCE_AWAKE);
+        break;
+
+    case PMW3610_ATTR_POS_RATE_250:
+        val->val1 = pos_rate_ms(&cfg) == PMW3610_POS_RATE_250HZ_MS;
+        break;
+
+    case PMW3610_ATTR_GAMING_MODE:
+        val->val1 = (cfg.performance & PMW3610_PERFORMANCE_FORCE_AWAKE) &&
+                    pos_rate_ms(&cfg) == PMW3610_POS_RATE_250HZ_MS;
+        break;
+
+    default:
+        return -ENOTSUP;
+    }
+
+    return 0;
+}
+
 static const struct sensor_driver_api pmw3610_driver_api = {
     .attr_set = pmw3610_attr_set,
+    .attr_get = pmw3610_attr_get,
 };
 
+bool pmw3610_is_device(const struct device *dev) {
+    return dev->api == &pmw3610_driver_api;
+}
+
+#if IS_ENABLED(CONFIG_PM_DEVICE)
+static int pm_action_owned(const struct device *dev, void *arg) {
+    struct pixart_data *data = dev->data;
+    enum pm_device_action action = *(enum pm_device_action *)arg;
+    struct k_work_sync sync;
+    int err;
+
+    switch (action) {
+    case PM_DEVICE_ACTION_SUSPEND:
+        set_interrupt(dev, false);
+        // wait for work running on another queue thread, nothing may touch
+        // the sensor after the shutdown command
+        k_work_cancel_delayable_sync(&data->init_work, &sync);
+        k_work_cancel_sync(&data->trigger_work, &sync);
+#if IS_ENABLED(CONFIG_PMW3610_IRQ_WATCHDOG)
+        k_work_cancel_delayable_sync(&data->poll_work, &sync);
+        data->polling = false;
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_HEALTH_CHECK)
+        k_work_cancel_delayable_sync(&data->health_work, &sync);
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_ADAPTIVE_DOWNSHIFT)
+        k_work_cancel_delayable_sync(&data->adapt_work, &sync);
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_DEFERRED_CONFIG)
+        k_work_cancel_delayable_sync(&data->pending_work, &sync);
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_DYNAMIC_CPI)
+        k_work_cancel_sync(&data->cpi_work, &sync);
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_OVERFLOW_ACTION_RAISE_RATE)
+        k_work_cancel_delayable_sync(&data->rate_work, &sync);
+        data->rate_boost = false;
+#endif
+        data->ready = false;
+        POWER_SUSPEND(data);
+
+        err = pmw3610_write(dev, PMW3610_REG_SHUTDOWN, PMW3610_SHUTDOWN_CMD);
+        if (err) {
+            LOG_ERR("Failed to shut down sensor");
+        }
+        return err;
+
+    case PM_DEVICE_ACTION_RESUME:
+        // wake-up replaces the power-up reset, configure restores the shadow
+        err = pmw3610_write_reg(dev, PMW3610_REG_POWER_UP_RESET, PMW3610_POWERUP_CMD_WAKEUP);
+        if (err) {
+            LOG_ERR("Failed to wake up sensor");
+            return err;
+        }
+
+        data->t_wake = k_cycle_get_32();
+        POWER_RESUME(data);
+#if IS_ENABLED(CONFIG_PMW3610_HEALTH_CHECK)
+        k_work_schedule(&data->health_work, K_SECONDS(CONFIG_PMW3610_HEALTH_CHECK_INTERVAL_S));
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_ADAPTIVE_DOWNSHIFT)
+        k_work_schedule(&data->adapt_work, K_SECONDS(CONFIG_PMW3610_ADAPTIVE_PERIOD_S));
+#endif
+#if IS_ENABLED(CONFIG_PMW3610_DEFERRED_CONFIG)
+        // merge changes staged while suspended, the configure step writes them
+        k_work_schedule(&data->pending_work, K_NO_WAIT);
+#endif
+        data->wake_ready_pending = true;
+        data->wake_report_pending = true;
+        data->resume.wake_to_ready_us = 0;
+        data->resume.wake_to_first_report_us = 0;
+
+#if IS_ENABLED(CONFIG_PMW3610_WARM_RESUME)
+        // skip the observation self-test, async init checks the product id
+        data->ready = false;
+        data->warm_resume = true;
+        data->resume.warm_resumes++;
+        data->async_init_step = ASYNC_INIT_STEP_CONFIGURE;
+        schedule_async_init(data, CONFIG_PMW3610_WARM_RESUME_DELAY_MS);
+#else
+        restart_async_init(data, ASYNC_INIT_STEP_CLEAR_OB1);
+#endif
+        return 0;
+
+    default:
+        return -ENOTSUP;
+    }
+}
+
+static int pmw3610_pm_action(const struct device *dev, enum pm_device_action action) {
+    return owner_call(dev, pm_action_owned, &action);
+}
+#endif
+
 #define PMW3610_SPI_MODE (SPI_OP_MODE_MASTER | SPI_WORD_SET(8) | SPI_MODE_CPOL | \
                         SPI_MODE_CPHA | SPI_TRANSFER_MSB)
 
@@ -628,12 +3066,59 @@ static const struct sensor_driver_api pmw3610_driver_api = {
 		.spi = SPI_DT_SPEC_INST_GET(n, PMW3610_SPI_MODE, 0),		                               \
         .irq_gpio = GPIO_DT_SPEC_INST_GET(n, irq_gpios),                                           \
         .cpi = DT_PROP(DT_DRV_INST(n), cpi),                                                       \
+        .force_awake = DT_PROP(DT_DRV_INST(n), force_awake),                                       \
+        .pos_rate_250 = DT_PROP(DT_DRV_INST(n), pos_rate_250),                                     \
         .evt_type = DT_PROP(DT_DRV_INST(n), evt_type),                                             \
         .x_input_code = DT_PROP(DT_DRV_INST(n), x_input_code),                                     \
         .y_input_code = DT_PROP(DT_DRV_INST(n), y_input_code),                                     \
     };                                                                                             \
                                                                                                    \
-    DEVICE_DT_INST_DEFINE(n, pmw3610_init, NULL, &data##n, &config##n, POST_KERNEL,                \
-                          CONFIG_SENSOR_INIT_PRIORITY, &pmw3610_driver_api);
+    PM_DEVICE_DT_INST_DEFINE(n, pmw3610_pm_action);                                                \
+                                                                                                   \
+    DEVICE_DT_INST_DEFINE(n, pmw3610_init, PM_DEVICE_DT_INST_GET(n), &data##n, &config##n,         \
+                          POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY, &pmw3610_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(PMW3610_DEFINE)
+
+#if IS_ENABLED(CONFIG_PMW3610_PM_ACTIVITY)
+#define PMW3610_DEVICE_REF(n) DEVICE_DT_INST_GET(n),
+
+static const struct device *const pmw3610_devices[] = {
+    DT_INST_FOREACH_STATUS_OKAY(PMW3610_DEVICE_REF)
+};
+
+static int pmw3610_activity_listener(const zmk_event_t *eh) {
+    struct zmk_activity_state_changed *ev = as_zmk_activity_state_changed(eh);
+    enum pm_device_action action;
+
+    switch (ev->state) {
+    case ZMK_ACTIVITY_ACTIVE:
+        action = PM_DEVICE_ACTION_RESUME;
+        break;
+    case ZMK_ACTIVITY_IDLE:
+        if (!IS_ENABLED(CONFIG_PMW3610_PM_SUSPEND_ON_IDLE)) {
+            return ZMK_EV_EVENT_BUBBLE;
+        }
+        action = PM_DEVICE_ACTION_SUSPEND;
+        break;
+    case ZMK_ACTIVITY_SLEEP:
+        action = PM_DEVICE_ACTION_SUSPEND;
+        break;
+    default:
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(pmw3610_devices); i++) {
+        // -EALREADY when the sensor is in the requested state already
+        int err = pm_device_action_run(pmw3610_devices[i], action);
+        if (err && err != -EALREADY) {
+            LOG_ERR("%s: pm action %d failed (%d)", pmw3610_devices[i]->name, action, err);
+        }
+    }
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(pmw3610, pmw3610_activity_listener);
+ZMK_SUBSCRIPTION(pmw3610, zmk_activity_state_changed);
+#endif
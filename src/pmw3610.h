@@ -66,6 +66,12 @@ extern "C" {
 #define PMW3610_POWERUP_CMD_RESET 0x5A
 #define PMW3610_POWERUP_CMD_WAKEUP 0x96
 
+/* Self test register command, starts the CRC based built-in self test */
+#define PMW3610_SELF_TEST_CMD 0x01
+
+/* Shutdown register command */
+#define PMW3610_SHUTDOWN_CMD 0xE7
+
 /* spi clock enable/disable commands */
 #define PMW3610_SPI_CLOCK_CMD_ENABLE 0xBA
 #define PMW3610_SPI_CLOCK_CMD_DISABLE 0xB5
@@ -73,20 +79,49 @@ extern "C" {
 /* Max register count readable in a single motion burst */
 #define PMW3610_MAX_BURST_SIZE 10
 
-/* Register count used for reading a single motion burst */
-#define PMW3610_BURST_SIZE 7
+/* Register counts of a motion burst: deltas only, with shutter, with surface stats */
+#define PMW3610_BURST_SIZE_MOTION 4
+#define PMW3610_BURST_SIZE_SHUTTER 7
+#define PMW3610_BURST_SIZE_SURFACE PMW3610_MAX_BURST_SIZE
+
+/* MOTION register fields */
+#define PMW3610_MOTION_MOT BIT(7) // motion since last report
+#define PMW3610_MOTION_OVF BIT(4) // delta overflowed since last report
 
 /* Position in the motion registers */
 #define PMW3610_X_L_POS 1
 #define PMW3610_Y_L_POS 2
 #define PMW3610_XY_H_POS 3
+#define PMW3610_SQUAL_POS 4
 #define PMW3610_SHUTTER_H_POS 5
 #define PMW3610_SHUTTER_L_POS 6
+#define PMW3610_PIX_MAX_POS 7
+#define PMW3610_PIX_AVG_POS 8
+#define PMW3610_PIX_MIN_POS 9
+
+/* PERFORMANCE register fields */
+#define PMW3610_PERFORMANCE_POS_RATE_MASK 0x0F
+#define PMW3610_PERFORMANCE_POS_RATE_250HZ 0x0D
+#define PMW3610_PERFORMANCE_FORCE_AWAKE 0xF0
+
+/* Position sample period in RUN mode (in ms) */
+#define PMW3610_POS_RATE_DEFAULT_MS 8
+#define PMW3610_POS_RATE_250HZ_MS 4
+
+/* Frame capture geometry and pixel grab register layout */
+#define PMW3610_FRAME_WIDTH 19
+#define PMW3610_FRAME_HEIGHT 19
+#define PMW3610_PIXEL_GRAB_VALID BIT(7)
+#define PMW3610_PIXEL_DATA_MASK 0x7F
+#define PMW3610_FRAME_GRAB_CMD 0x83
 
 /* cpi/resolution range */
 #define PMW3610_MAX_CPI 3200
 #define PMW3610_MIN_CPI 200
 
+/* highest SCLK rate of the datasheet */
+#define PMW3610_MAX_SPI_HZ 2000000
+
 /* write command bit position */
 #define SPI_WRITE_BIT BIT(7)
 
@@ -118,8 +153,252 @@ enum pmw3610_attribute {
 	/** Sampling frequency time during REST3 mode [ms]. */
 	PMW3610_ATTR_REST3_SAMPLE_TIME,
 
+	/** Keep the sensor in RUN mode (bool). */
+	PMW3610_ATTR_FORCE_AWAKE,
+
+	/** Sample at 250 Hz position rate in RUN mode (bool). */
+	PMW3610_ATTR_POS_RATE_250,
+
+	/** Gaming profile, force awake at 250 Hz position rate (bool). */
+	PMW3610_ATTR_GAMING_MODE,
+
+};
+
+/** @brief Decoded content of a full motion burst, in sensor axes. */
+struct pmw3610_burst {
+	uint8_t motion;
+	int16_t dx;
+	int16_t dy;
+	uint8_t squal;
+	uint16_t shutter;
+	uint8_t pix_max;
+	uint8_t pix_avg;
+	uint8_t pix_min;
+};
+
+/** @brief Driver state of a PMW3610 instance. */
+struct pmw3610_status {
+	/** Whether the sensor finished its init sequence. */
+	bool ready;
+	/** Current step of the async init sequence. */
+	int init_step;
+	/** Error code of the last failed init step. */
+	int init_err;
+	/** Whether the smart algorithm is currently switched on. */
+	bool smart_flag;
+	/** SPI frequency in use [Hz]. */
+	uint32_t spi_hz;
+	/** Register count read per motion burst. */
+	uint8_t burst_len;
+	/** SQUAL and pixel statistics of the last burst, with CONFIG_PMW3610_SURFACE_STATS. */
+	uint8_t squal;
+	uint8_t pix_max;
+	uint8_t pix_avg;
+	uint8_t pix_min;
+	/** Whether the irq watchdog holds the irq off and polls the sensor. */
+	bool polling;
+	/** Time waited before each step of the last init sequence [ms]. */
+	uint32_t init_wait_ms[PMW3610_INIT_STEP_COUNT];
+	/** Longest wait of a motion burst for the shared bus, with CONFIG_PMW3610_BUS_ARBITER [us]. */
+	uint32_t bus_wait_max_us;
 };
 
+/** @brief Check whether a device is a PMW3610 instance. */
+bool pmw3610_is_device(const struct device *dev);
+
+/** @brief Get the driver state of a PMW3610 instance. */
+int pmw3610_get_status(const struct device *dev, struct pmw3610_status *status);
+
+/**
+ * @brief Get the motion path counters of a PMW3610 instance.
+ *
+ * @param dev PMW3610 device.
+ * @param stats Filled with the counters, indexed by enum pmw3610_stat.
+ * @return 0 on success, -ENOTSUP if CONFIG_PMW3610_STATS is disabled.
+ */
+int pmw3610_get_stats(const struct device *dev, uint32_t stats[PMW3610_STAT_COUNT]);
+
+/** @brief Clear the motion path counters of a PMW3610 instance. */
+void pmw3610_reset_stats(const struct device *dev);
+
+/** @brief Get the printable name of a counter. */
+const char *pmw3610_stat_name(enum pmw3610_stat stat);
+
+/**
+ * @brief Get a latency histogram of a PMW3610 instance.
+ *
+ * Bucket 0 counts latencies below 1 us, bucket i counts [2^(i-1), 2^i) us,
+ * the last bucket also counts everything above.
+ *
+ * @param dev PMW3610 device.
+ * @param seg Latency segment.
+ * @param buckets Filled with the bucket counts.
+ * @param count Size of @p buckets.
+ * @return Number of buckets copied, -ENOTSUP if histograms are compiled out.
+ */
+int pmw3610_get_latency(const struct device *dev, enum pmw3610_latency_segment seg,
+                        uint32_t *buckets, size_t count);
+
+/** @brief Clear the latency histograms of a PMW3610 instance. */
+void pmw3610_reset_latency(const struct device *dev);
+
+/** @brief Callback invoked per trace record by pmw3610_trace_dump(). */
+typedef void (*pmw3610_trace_cb_t)(const struct pmw3610_trace_entry *entry, void *user_data);
+
+/**
+ * @brief Walk the trace buffer of a PMW3610 instance, oldest record first.
+ *
+ * The buffer keeps being written while it is walked, records being
+ * overwritten meanwhile may show up torn.
+ *
+ * @return Number of records walked, -ENOTSUP if tracing is compiled out.
+ */
+int pmw3610_trace_dump(const struct device *dev, pmw3610_trace_cb_t cb, void *user_data);
+
+/** @brief Drop all records of the trace buffer. */
+void pmw3610_trace_clear(const struct device *dev);
+
+/** @brief Get the printable name of a trace record type. */
+const char *pmw3610_trace_type_name(uint8_t type);
+
+/**
+ * @brief Save the trace buffer as csv file, e.g. on native_sim.
+ *
+ * @return 0 on success, -ENOTSUP if CONFIG_PMW3610_TRACE_FILE is disabled.
+ */
+int pmw3610_trace_save(const struct device *dev, const char *path);
+
+/** @brief Estimated mode residency and energy use of the sensor. */
+struct pmw3610_power {
+	/** Time spent in each mode since boot or reset [ms], see enum pmw3610_mode. */
+	uint64_t residency_ms[PMW3610_MODE_COUNT];
+	/** Average sensor current over the residency time [uA]. */
+	uint32_t avg_current_ua;
+	/** Sensor energy per hour at the average current [uWh]. */
+	uint32_t energy_uwh_per_hour;
+};
+
+/**
+ * @brief Get the estimated mode residency and energy use of a PMW3610 instance.
+ *
+ * Residency is inferred from motion timestamps and the configured downshift
+ * times, currents are taken from CONFIG_PMW3610_*_CURRENT_UA figures. Time
+ * the sensor spends suspended is not counted.
+ *
+ * @return 0 on success, -ENOTSUP if CONFIG_PMW3610_POWER_ESTIMATE is disabled.
+ */
+int pmw3610_get_power(const struct device *dev, struct pmw3610_power *power);
+
+/** @brief Restart the mode residency accounting of a PMW3610 instance. */
+void pmw3610_reset_power(const struct device *dev);
+
+/**
+ * @brief Get the resume counters and the timings of the last resume from shutdown.
+ *
+ * Timings are measured from the wake-up command and stay 0 until the sensor
+ * is ready or has reported motion.
+ *
+ * @return 0 on success, -ENOTSUP if CONFIG_PM_DEVICE is disabled.
+ */
+int pmw3610_get_resume_metrics(const struct device *dev, struct pmw3610_resume_metrics *metrics);
+
+/**
+ * @brief Get the boot profile of the async init sequence.
+ *
+ * @return 0 on success, -ENOTSUP if CONFIG_PMW3610_BOOT_PROFILE is disabled.
+ */
+int pmw3610_get_boot_profile(const struct device *dev, struct pmw3610_boot_profile *profile);
+
+/**
+ * @brief Find the highest reliable SPI frequency and switch to it.
+ *
+ * Steps the frequency up from the devicetree value while a readback test
+ * passes, then applies the highest passing one minus a safety margin and
+ * stores it in settings.
+ *
+ * @param dev PMW3610 device.
+ * @param freq_hz Set to the applied frequency.
+ * @return 0 on success, -EIO if the devicetree frequency fails already,
+ *         -ENOTSUP if CONFIG_PMW3610_SPI_AUTOTUNE is disabled.
+ */
+int pmw3610_spi_autotune(const struct device *dev, uint32_t *freq_hz);
+
+/**
+ * @brief Run the built-in self test and check its CRC signature.
+ *
+ * Blocks for CONFIG_PMW3610_BIST_DURATION_MS, the sensor is re-initialized
+ * afterwards and is not ready until the init sequence completes.
+ *
+ * @return 0 if the test ran (see result->pass), -EBUSY if the sensor is not
+ *         ready, -ENOTSUP if CONFIG_PMW3610_BIST is disabled.
+ */
+int pmw3610_bist(const struct device *dev, struct pmw3610_bist_result *result);
+
+/**
+ * @brief Get the result of the last built-in self test, including one run at boot.
+ *
+ * @return 0 on success, -ENODATA if no test ran yet, -ENOTSUP if
+ *         CONFIG_PMW3610_BIST is disabled.
+ */
+int pmw3610_get_bist_result(const struct device *dev, struct pmw3610_bist_result *result);
+
+/**
+ * @brief Claim the shared SPI bus for one chunk of a low priority transfer.
+ *
+ * Drivers sharing the bus with the sensor, e.g. a display, split long
+ * transfers into chunks and bracket each one with this call and
+ * pmw3610_bus_chunk_end(). Pending motion bursts go first, so the call
+ * waits until none is left. Must not be called from the system workqueue.
+ *
+ * @param dev PMW3610 device on the shared bus.
+ * @param timeout Longest time to wait for the bus.
+ * @return 0 if the bus is claimed, -EAGAIN on timeout, -ENOTSUP if
+ *         CONFIG_PMW3610_BUS_ARBITER is disabled.
+ */
+int pmw3610_bus_chunk_begin(const struct device *dev, k_timeout_t timeout);
+
+/** @brief Release the bus claimed by pmw3610_bus_chunk_begin(). */
+void pmw3610_bus_chunk_end(const struct device *dev);
+
+/** @brief Read a single sensor register. */
+int pmw3610_reg_read(const struct device *dev, uint8_t addr, uint8_t *value);
+
+/**
+ * @brief Read a full motion burst.
+ *
+ * The deltas read here are consumed and will not be reported as input.
+ */
+int pmw3610_burst_read(const struct device *dev, struct pmw3610_burst *burst);
+
+/** @brief Rerun the OBSERVATION and product id self-test. */
+int pmw3610_self_test(const struct device *dev);
+
+/** @brief Quality figures of a grabbed frame. */
+struct pmw3610_frame_quality {
+	/** Mean squared difference between neighbouring pixels. */
+	uint32_t sharpness;
+	/** Michelson contrast of the frame [%]. */
+	uint8_t contrast;
+	/** Brightness uniformity between rows [%]. */
+	uint8_t uniformity;
+	/** Average pixel value. */
+	uint8_t mean;
+	/** Combined score of the above [0 - 100]. */
+	uint8_t score;
+};
+
+/**
+ * @brief Grab a frame and compute its focus and surface quality.
+ *
+ * Motion reporting is paused during the capture and the sensor is
+ * re-initialized afterwards.
+ *
+ * @param dev PMW3610 device.
+ * @param quality Filled with the analysis result.
+ * @return 0 on success, negative errno otherwise.
+ */
+int pmw3610_frame_analyze(const struct device *dev, struct pmw3610_frame_quality *quality);
+
 #ifdef __cplusplus
 }
 #endif
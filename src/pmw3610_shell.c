@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include "pmw3610.h"
+
+static const struct device *get_device(const struct shell *sh, const char *name) {
+    const struct device *dev = device_get_binding(name);
+
+    if (dev == NULL || !pmw3610_is_device(dev)) {
+        shell_error(sh, "%s is not a PMW3610 device", name);
+        return NULL;
+    }
+
+    return dev;
+}
+
+static int parse_u32(const struct shell *sh, const char *str, uint32_t *value) {
+    char *end;
+
+    *value = strtoul(str, &end, 0);
+    if (*str == '\0' || *end != '\0') {
+        shell_error(sh, "Invalid number: %s", str);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/* get or set a single time/cpi attribute, depending on the presence of argv[0] */
+static int attr_get_set(const struct shell *sh, const struct device *dev,
+                        enum pmw3610_attribute attr, const char *unit, size_t argc, char **argv) {
+    struct sensor_value val = {0};
+    int err;
+
+    if (argc > 0) {
+        uint32_t value;
+        err = parse_u32(sh, argv[0], &value);
+        if (err) {
+            return err;
+        }
+
+        val.val1 = value;
+        err = sensor_attr_set(dev, SENSOR_CHAN_ALL, (enum sensor_attribute)attr, &val);
+        if (err) {
+            shell_error(sh, "Failed to set attribute (%d)", err);
+            return err;
+        }
+    }
+
+    err = sensor_attr_get(dev, SENSOR_CHAN_ALL, (enum sensor_attribute)attr, &val);
+    if (err) {
+        shell_error(sh, "Failed to get attribute (%d)", err);
+        return err;
+    }
+
+    shell_print(sh, "%d%s", val.val1, unit);
+    return 0;
+}
+
+static int cmd_cpi(const struct shell *sh, size_t argc, char **argv) {
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    return attr_get_set(sh, dev, PMW3610_ATTR_CPI, "", argc - 2, &argv[2]);
+}
+
+static int cmd_downshift(const struct shell *sh, size_t argc, char **argv) {
+    enum pmw3610_attribute attr;
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (strcmp(argv[2], "run") == 0) {
+        attr = PMW3610_ATTR_RUN_DOWNSHIFT_TIME;
+    } else if (strcmp(argv[2], "rest1") == 0) {
+        attr = PMW3610_ATTR_REST1_DOWNSHIFT_TIME;
+    } else if (strcmp(argv[2], "rest2") == 0) {
+        attr = PMW3610_ATTR_REST2_DOWNSHIFT_TIME;
+    } else {
+        shell_error(sh, "Unknown mode %s, expecting run, rest1 or rest2", argv[2]);
+        return -EINVAL;
+    }
+
+    return attr_get_set(sh, dev, attr, " ms", argc - 3, &argv[3]);
+}
+
+static int cmd_rest(const struct shell *sh, size_t argc, char **argv) {
+    enum pmw3610_attribute attr;
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (strcmp(argv[2], "1") == 0) {
+        attr = PMW3610_ATTR_REST1_SAMPLE_TIME;
+    } else if (strcmp(argv[2], "2") == 0) {
+        attr = PMW3610_ATTR_REST2_SAMPLE_TIME;
+    } else if (strcmp(argv[2], "3") == 0) {
+        attr = PMW3610_ATTR_REST3_SAMPLE_TIME;
+    } else {
+        shell_error(sh, "Unknown rest mode %s, expecting 1, 2 or 3", argv[2]);
+        return -EINVAL;
+    }
+
+    return attr_get_set(sh, dev, attr, " ms", argc - 3, &argv[3]);
+}
+
+static int cmd_perf(const struct shell *sh, size_t argc, char **argv) {
+    struct sensor_value awake = {0}, fast = {0};
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc > 2) {
+        if (strcmp(argv[2], "normal") == 0) {
+            awake.val1 = 0;
+            fast.val1 = 0;
+        } else if (strcmp(argv[2], "fast") == 0) {
+            awake.val1 = 0;
+            fast.val1 = 1;
+        } else if (strcmp(argv[2], "awake") == 0) {
+            awake.val1 = 1;
+            fast.val1 = 0;
+        } else if (strcmp(argv[2], "gaming") == 0) {
+            awake.val1 = 1;
+            fast.val1 = 1;
+        } else {
+            shell_error(sh, "Unknown profile %s, expecting normal, fast, awake or gaming", argv[2]);
+            return -EINVAL;
+        }
+
+        int err = sensor_attr_set(dev, SENSOR_CHAN_ALL,
+                                  (enum sensor_attribute)PMW3610_ATTR_FORCE_AWAKE, &awake);
+        if (!err) {
+            err = sensor_attr_set(dev, SENSOR_CHAN_ALL,
+                                  (enum sensor_attribute)PMW3610_ATTR_POS_RATE_250, &fast);
+        }
+        if (err) {
+            shell_error(sh, "Failed to set profile (%d)", err);
+            return err;
+        }
+    }
+
+    sensor_attr_get(dev, SENSOR_CHAN_ALL, (enum sensor_attribute)PMW3610_ATTR_FORCE_AWAKE, &awake);
+    sensor_attr_get(dev, SENSOR_CHAN_ALL, (enum sensor_attribute)PMW3610_ATTR_POS_RATE_250, &fast);
+    shell_print(sh, "force awake: %s, pos rate: %s", awake.val1 ? "on" : "off",
+                fast.val1 ? "250 Hz" : "125 Hz");
+    return 0;
+}
+
+/* registers safe to read at any time, i.e. without side effect on motion data */
+static const struct {
+    uint8_t addr;
+    const char *name;
+} dump_regs[] = {
+    {PMW3610_REG_PRODUCT_ID, "PRODUCT_ID"},
+    {PMW3610_REG_REVISION_ID, "REVISION_ID"},
+    {PMW3610_REG_SQUAL, "SQUAL"},
+    {PMW3610_REG_SHUTTER_HIGHER, "SHUTTER_HIGHER"},
+    {PMW3610_REG_SHUTTER_LOWER, "SHUTTER_LOWER"},
+    {PMW3610_REG_PIX_MAX, "PIX_MAX"},
+    {PMW3610_REG_PIX_AVG, "PIX_AVG"},
+    {PMW3610_REG_PIX_MIN, "PIX_MIN"},
+    {PMW3610_REG_PERFORMANCE, "PERFORMANCE"},
+    {PMW3610_REG_RUN_DOWNSHIFT, "RUN_DOWNSHIFT"},
+    {PMW3610_REG_REST1_RATE, "REST1_RATE"},
+    {PMW3610_REG_REST1_DOWNSHIFT, "REST1_DOWNSHIFT"},
+    {PMW3610_REG_REST2_RATE, "REST2_RATE"},
+    {PMW3610_REG_REST2_DOWNSHIFT, "REST2_DOWNSHIFT"},
+    {PMW3610_REG_REST3_RATE, "REST3_RATE"},
+    {PMW3610_REG_OBSERVATION, "OBSERVATION"},
+    {PMW3610_REG_NOT_REV_ID, "NOT_REV_ID"},
+    {PMW3610_REG_NOT_PROD_ID, "NOT_PROD_ID"},
+};
+
+static int cmd_regs(const struct shell *sh, size_t argc, char **argv) {
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(dump_regs); i++) {
+        uint8_t value;
+        int err = pmw3610_reg_read(dev, dump_regs[i].addr, &value);
+        if (err) {
+            shell_error(sh, "Failed to read %s (%d)", dump_regs[i].name, err);
+            return err;
+        }
+        shell_print(sh, "0x%02x %-16s 0x%02x", dump_regs[i].addr, dump_regs[i].name, value);
+    }
+
+    return 0;
+}
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv) {
+    struct pmw3610_status status;
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    pmw3610_get_status(dev, &status);
+    shell_print(sh, "ready:      %s", status.ready ? "yes" : "no");
+    shell_print(sh, "init step:  %d", status.init_step);
+    shell_print(sh, "init error: %d", status.init_err);
+    shell_print(sh, "polling:    %s", status.polling ? "yes" : "no");
+    shell_print(sh, "spi:        %u Hz", status.spi_hz);
+    shell_print(sh, "burst len:  %u", status.burst_len);
+    shell_print(sh, "bus wait:   %u us max", status.bus_wait_max_us);
+    if (status.burst_len == PMW3610_BURST_SIZE_SURFACE) {
+        shell_print(sh, "surface:    squal %u, pix %u/%u/%u (max/avg/min)", status.squal,
+                    status.pix_max, status.pix_avg, status.pix_min);
+    }
+    shell_print(sh, "init waits: %u/%u/%u/%u ms", status.init_wait_ms[0], status.init_wait_ms[1],
+                status.init_wait_ms[2], status.init_wait_ms[3]);
+    shell_print(sh, "smart algo: %s", status.smart_flag ? "on" : "off");
+
+    uint32_t stats[PMW3610_STAT_COUNT];
+    if (pmw3610_get_stats(dev, stats) == 0) {
+        for (int i = 0; i < PMW3610_STAT_COUNT; i++) {
+            shell_print(sh, "%-14s %u", pmw3610_stat_name(i), stats[i]);
+        }
+    }
+
+    struct pmw3610_power power;
+    if (pmw3610_get_power(dev, &power) == 0) {
+        static const char *const mode_names[PMW3610_MODE_COUNT] = {"run", "rest1", "rest2",
+                                                                   "rest3"};
+        for (int i = 0; i < PMW3610_MODE_COUNT; i++) {
+            shell_print(sh, "%-14s %llu ms", mode_names[i],
+                        (unsigned long long)power.residency_ms[i]);
+        }
+        shell_print(sh, "%-14s %u uA", "avg_current", power.avg_current_ua);
+        shell_print(sh, "%-14s %u uWh/h", "energy", power.energy_uwh_per_hour);
+    }
+
+    struct pmw3610_resume_metrics resume;
+    if (pmw3610_get_resume_metrics(dev, &resume) == 0) {
+        shell_print(sh, "%-14s %u", "warm_resumes", resume.warm_resumes);
+        shell_print(sh, "%-14s %u", "cold_fallbacks", resume.cold_fallbacks);
+        shell_print(sh, "%-14s %u us", "wake_to_ready", resume.wake_to_ready_us);
+        shell_print(sh, "%-14s %u us", "wake_to_report", resume.wake_to_first_report_us);
+    }
+
+    if (argc > 2 && strcmp(argv[2], "reset") == 0) {
+        pmw3610_reset_stats(dev);
+        pmw3610_reset_power(dev);
+        shell_print(sh, "Counters cleared");
+    }
+
+    return 0;
+}
+
+static int cmd_latency(const struct shell *sh, size_t argc, char **argv) {
+    static const char *const seg_names[PMW3610_LATENCY_COUNT] = {
+        [PMW3610_LATENCY_IRQ_TO_WORK] = "irq to work",
+        [PMW3610_LATENCY_SPI_BURST] = "spi burst",
+        [PMW3610_LATENCY_PROCESSING] = "processing",
+        [PMW3610_LATENCY_GATE_WAIT] = "gate wait",
+        [PMW3610_LATENCY_BUS_WAIT] = "bus wait",
+    };
+    uint32_t buckets[32];
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    for (int seg = 0; seg < PMW3610_LATENCY_COUNT; seg++) {
+        int n = pmw3610_get_latency(dev, seg, buckets, ARRAY_SIZE(buckets));
+        if (n < 0) {
+            shell_error(sh, "Latency histograms not enabled");
+            return n;
+        }
+
+        shell_print(sh, "%s:", seg_names[seg]);
+        for (int i = 0; i < n; i++) {
+            if (buckets[i] == 0) {
+                continue;
+            }
+            if (i == n - 1) {
+                shell_print(sh, "  >= %7u us: %u", i ? (uint32_t)BIT(i - 1) : 0, buckets[i]);
+            } else {
+                shell_print(sh, "  <  %7u us: %u", (uint32_t)BIT(i), buckets[i]);
+            }
+        }
+    }
+
+    if (argc > 2 && strcmp(argv[2], "reset") == 0) {
+        pmw3610_reset_latency(dev);
+        shell_print(sh, "Histograms cleared");
+    }
+
+    return 0;
+}
+
+static void print_trace_entry(const struct pmw3610_trace_entry *entry, void *user_data) {
+    const struct shell *sh = user_data;
+
+    shell_print(sh, "%10u %-7s 0x%02x %3u %u %6u", k_cyc_to_us_floor32(entry->timestamp),
+                pmw3610_trace_type_name(entry->type), entry->addr, entry->len, entry->clk_on,
+                k_cyc_to_us_floor32(entry->duration));
+}
+
+static int cmd_trace(const struct shell *sh, size_t argc, char **argv) {
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc > 2 && strcmp(argv[2], "clear") == 0) {
+        pmw3610_trace_clear(dev);
+        return 0;
+    }
+
+    if (argc > 3 && strcmp(argv[2], "save") == 0) {
+        int err = pmw3610_trace_save(dev, argv[3]);
+        if (err) {
+            shell_error(sh, "Failed to save trace (%d)", err);
+        }
+        return err;
+    }
+
+    shell_print(sh, "%10s %-7s %4s %3s %s %6s", "time_us", "type", "addr", "len", "c", "dur_us");
+    int n = pmw3610_trace_dump(dev, print_trace_entry, (void *)sh);
+    if (n < 0) {
+        shell_error(sh, "Tracing not enabled");
+        return n;
+    }
+
+    return 0;
+}
+
+static int cmd_boot(const struct shell *sh, size_t argc, char **argv) {
+    static const char *const step_names[PMW3610_INIT_STEP_COUNT] = {"power_up", "clear_ob1",
+                                                                     "check_ob1", "configure"};
+    struct pmw3610_boot_profile profile;
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    int err = pmw3610_get_boot_profile(dev, &profile);
+    if (err) {
+        shell_error(sh, "Boot profiling not enabled");
+        return err;
+    }
+
+    shell_print(sh, "%-10s %10s %10s %10s %8s", "step", "sched_us", "start_us", "end_us",
+                "spi_us");
+    for (int i = 0; i < PMW3610_INIT_STEP_COUNT; i++) {
+        const struct pmw3610_boot_step *step = &profile.steps[i];
+        shell_print(sh, "%-10s %10u %10u %10u %8u", step_names[i], step->scheduled_us,
+                    step->started_us, step->finished_us, step->spi_us);
+    }
+    shell_print(sh, "init to ready:        %u us", profile.init_to_ready_us);
+    shell_print(sh, "init to first report: %u us", profile.init_to_first_report_us);
+
+    return 0;
+}
+
+static int cmd_spi(const struct shell *sh, size_t argc, char **argv) {
+    struct pmw3610_status status;
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    if (argc > 2 && strcmp(argv[2], "autotune") == 0) {
+        uint32_t freq_hz;
+        int err = pmw3610_spi_autotune(dev, &freq_hz);
+        if (err) {
+            shell_error(sh, "Autotune failed (%d)", err);
+            return err;
+        }
+    }
+
+    pmw3610_get_status(dev, &status);
+    shell_print(sh, "%u Hz", status.spi_hz);
+    return 0;
+}
+
+static int cmd_bist(const struct shell *sh, size_t argc, char **argv) {
+    struct pmw3610_bist_result result;
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    int err = (argc > 2 && strcmp(argv[2], "run") == 0) ? pmw3610_bist(dev, &result)
+                                                         : pmw3610_get_bist_result(dev, &result);
+    if (err) {
+        shell_error(sh, "No self test result (%d)", err);
+        return err;
+    }
+
+    shell_print(sh, "%s: signature 0x%08x, read after %u ms", result.pass ? "PASS" : "FAIL",
+                result.crc, result.runtime_ms);
+    return result.pass ? 0 : -EIO;
+}
+
+static int cmd_selftest(const struct shell *sh, size_t argc, char **argv) {
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    int err = pmw3610_self_test(dev);
+    if (err) {
+        shell_error(sh, "Self-test failed (%d)", err);
+        return err;
+    }
+
+    shell_print(sh, "Self-test passed");
+    return 0;
+}
+
+static int cmd_burst(const struct shell *sh, size_t argc, char **argv) {
+    struct pmw3610_burst burst;
+    const struct device *dev = get_device(sh, argv[1]);
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+
+    int err = pmw3610_burst_read(dev, &burst);
+    if (err) {
+        shell_error(sh, "Burst read failed (%d)", err);
+        return err;
+    }
+
+    shell_print(sh, "motion:  0x%02x", burst.motion);
+    shell_print(sh, "dx, dy:  %d, %d", burst.dx, burst.dy);
+    shell_print(sh, "squal:   %u", burst.squal);
+    shell_print(sh, "shutter: %u", burst.shutter);
+    shell_print(sh, "pixel:   max %u, avg %u, min %u", burst.pix_max, burst.pix_avg,
+                burst.pix_min);
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_pmw3610,
+    SHELL_CMD_ARG(cpi, NULL, "Get or set CPI: <device> [cpi]", cmd_cpi, 2, 1),
+    SHELL_CMD_ARG(downshift, NULL, "Get or set downshift time: <device> <run|rest1|rest2> [ms]",
+                  cmd_downshift, 3, 1),
+    SHELL_CMD_ARG(rest, NULL, "Get or set rest sample time: <device> <1|2|3> [ms]", cmd_rest,
+                  3, 1),
+    SHELL_CMD_ARG(perf, NULL, "Get or set performance profile: <device> [normal|fast|awake|gaming]",
+                  cmd_perf, 2, 1),
+    SHELL_CMD_ARG(regs, NULL, "Dump registers: <device>", cmd_regs, 2, 0),
+    SHELL_CMD_ARG(stats, NULL, "Show driver state and counters: <device> [reset]", cmd_stats, 2,
+                  1),
+    SHELL_CMD_ARG(latency, NULL, "Show latency histograms: <device> [reset]", cmd_latency, 2, 1),
+    SHELL_CMD_ARG(trace, NULL, "Dump trace buffer: <device> [clear | save <path>]", cmd_trace, 2,
+                  2),
+    SHELL_CMD_ARG(boot, NULL, "Show boot init profile: <device>", cmd_boot, 2, 0),
+    SHELL_CMD_ARG(spi, NULL, "Show or autotune SPI frequency: <device> [autotune]", cmd_spi, 2,
+                  1),
+    SHELL_CMD_ARG(bist, NULL, "Show or run CRC built-in self test: <device> [run]", cmd_bist, 2,
+                  1),
+    SHELL_CMD_ARG(selftest, NULL, "Run self-test: <device>", cmd_selftest, 2, 0),
+    SHELL_CMD_ARG(burst, NULL, "Read and decode one motion burst: <device>", cmd_burst, 2, 0),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(pmw3610, &sub_pmw3610, "PMW3610 sensor commands", NULL);